@@ -51,18 +51,23 @@ pub use data::value::{DataValue, Num, RegexWrapper, UuidWrapper, Validity, Valid
 pub use fixed_rule::{FixedRule, FixedRuleInputRelation, FixedRulePayload};
 pub use runtime::db::Db;
 pub use runtime::db::NamedRows;
+pub use runtime::db::{RelationChange, RelationChanges};
 pub use runtime::relation::decode_tuple_from_kv;
 pub use runtime::temp_store::RegularTempStore;
 pub use storage::mem::{new_cozo_mem, MemStorage};
 #[cfg(feature = "storage-rocksdb")]
-pub use storage::rocks::{new_cozo_rocksdb, RocksDbStorage};
+pub use storage::rocks::{
+    new_cozo_rocksdb, new_cozo_rocksdb_with_options, restore_cozo_rocksdb_backup,
+    RocksDbBlobOptions, RocksDbBulkLoadOptions, RocksDbOptions, RocksDbStorage,
+    RocksDbValidityRetention,
+};
 #[cfg(feature = "storage-sled")]
 pub use storage::sled::{new_cozo_sled, SledStorage};
 #[cfg(feature = "storage-sqlite")]
 pub use storage::sqlite::{new_cozo_sqlite, SqliteStorage};
 #[cfg(feature = "storage-tikv")]
 pub use storage::tikv::{new_cozo_tikv, TiKvStorage};
-pub use storage::{Storage, StoreTx};
+pub use storage::{Storage, StorageChange, StoreTx};
 
 pub use crate::data::expr::Expr;
 use crate::data::json::JsonValue;
@@ -134,7 +139,7 @@ impl DbInstance {
     /// some of the engines are available. The `mem` engine is always available.
     ///
     /// `path` is ignored for `mem` and `tikv` engines.
-    /// `options` is ignored for every engine except `tikv`.
+    /// `options` is ignored for every engine except `rocksdb` (see `RocksDbOptions`) and `tikv`.
     #[allow(unused_variables)]
     pub fn new(engine: &str, path: impl AsRef<Path>, options: &str) -> Result<Self> {
         let options = if options.is_empty() { "{}" } else { options };
@@ -143,7 +148,10 @@ impl DbInstance {
             #[cfg(feature = "storage-sqlite")]
             "sqlite" => Self::Sqlite(new_cozo_sqlite(path)?),
             #[cfg(feature = "storage-rocksdb")]
-            "rocksdb" => Self::RocksDb(new_cozo_rocksdb(path)?),
+            "rocksdb" => {
+                let opts: RocksDbOptions = serde_json::from_str(options).into_diagnostic()?;
+                Self::RocksDb(new_cozo_rocksdb_with_options(path, opts)?)
+            }
             #[cfg(feature = "storage-sled")]
             "sled" => Self::Sled(new_cozo_sled(path)?),
             #[cfg(feature = "storage-tikv")]
@@ -355,6 +363,103 @@ impl DbInstance {
             Err(err) => json!({"ok": false, "message": err.to_string()}).to_string(),
         }
     }
+    /// Dispatcher method. See [crate::Db::checkpoint].
+    pub fn checkpoint(&self, dir: impl AsRef<Path>) -> Result<()> {
+        match self {
+            DbInstance::Mem(db) => db.checkpoint(dir),
+            #[cfg(feature = "storage-sqlite")]
+            DbInstance::Sqlite(db) => db.checkpoint(dir),
+            #[cfg(feature = "storage-rocksdb")]
+            DbInstance::RocksDb(db) => db.checkpoint(dir),
+            #[cfg(feature = "storage-sled")]
+            DbInstance::Sled(db) => db.checkpoint(dir),
+            #[cfg(feature = "storage-tikv")]
+            DbInstance::TiKv(db) => db.checkpoint(dir),
+        }
+    }
+    /// Write a checkpoint of the running database, with JSON string return value.
+    /// See [crate::Db::checkpoint].
+    pub fn checkpoint_str(&self, dir: impl AsRef<Path>) -> String {
+        match self.checkpoint(dir) {
+            Ok(_) => json!({"ok": true}).to_string(),
+            Err(err) => json!({"ok": false, "message": err.to_string()}).to_string(),
+        }
+    }
+    /// Dispatcher method. See [crate::Db::incremental_backup].
+    pub fn incremental_backup(&self, dir: impl AsRef<Path>) -> Result<()> {
+        match self {
+            DbInstance::Mem(db) => db.incremental_backup(dir),
+            #[cfg(feature = "storage-sqlite")]
+            DbInstance::Sqlite(db) => db.incremental_backup(dir),
+            #[cfg(feature = "storage-rocksdb")]
+            DbInstance::RocksDb(db) => db.incremental_backup(dir),
+            #[cfg(feature = "storage-sled")]
+            DbInstance::Sled(db) => db.incremental_backup(dir),
+            #[cfg(feature = "storage-tikv")]
+            DbInstance::TiKv(db) => db.incremental_backup(dir),
+        }
+    }
+    /// Add an incremental backup of the running database, with JSON string return value.
+    /// See [crate::Db::incremental_backup].
+    pub fn incremental_backup_str(&self, dir: impl AsRef<Path>) -> String {
+        match self.incremental_backup(dir) {
+            Ok(_) => json!({"ok": true}).to_string(),
+            Err(err) => json!({"ok": false, "message": err.to_string()}).to_string(),
+        }
+    }
+    /// Dispatcher method. See [crate::Db::catch_up_with_primary].
+    pub fn catch_up_with_primary(&self) -> Result<()> {
+        match self {
+            DbInstance::Mem(db) => db.catch_up_with_primary(),
+            #[cfg(feature = "storage-sqlite")]
+            DbInstance::Sqlite(db) => db.catch_up_with_primary(),
+            #[cfg(feature = "storage-rocksdb")]
+            DbInstance::RocksDb(db) => db.catch_up_with_primary(),
+            #[cfg(feature = "storage-sled")]
+            DbInstance::Sled(db) => db.catch_up_with_primary(),
+            #[cfg(feature = "storage-tikv")]
+            DbInstance::TiKv(db) => db.catch_up_with_primary(),
+        }
+    }
+    /// Catch up with the primary instance, with JSON string return value.
+    /// See [crate::Db::catch_up_with_primary].
+    pub fn catch_up_with_primary_str(&self) -> String {
+        match self.catch_up_with_primary() {
+            Ok(_) => json!({"ok": true}).to_string(),
+            Err(err) => json!({"ok": false, "message": err.to_string()}).to_string(),
+        }
+    }
+    /// Dispatcher method. See [crate::Db::changes_since].
+    pub fn changes_since(
+        &self,
+        relation: &str,
+        since: u64,
+        limit: usize,
+    ) -> Result<RelationChanges> {
+        match self {
+            DbInstance::Mem(db) => db.changes_since(relation, since, limit),
+            #[cfg(feature = "storage-sqlite")]
+            DbInstance::Sqlite(db) => db.changes_since(relation, since, limit),
+            #[cfg(feature = "storage-rocksdb")]
+            DbInstance::RocksDb(db) => db.changes_since(relation, since, limit),
+            #[cfg(feature = "storage-sled")]
+            DbInstance::Sled(db) => db.changes_since(relation, since, limit),
+            #[cfg(feature = "storage-tikv")]
+            DbInstance::TiKv(db) => db.changes_since(relation, since, limit),
+        }
+    }
+    /// Read back the writes to a stored relation, with JSON string return value.
+    /// See [crate::Db::changes_since] and [crate::RelationChanges::into_json].
+    pub fn changes_since_str(&self, relation: &str, since: u64, limit: usize) -> String {
+        match self.changes_since(relation, since, limit) {
+            Ok(changes) => {
+                let mut ret = changes.into_json();
+                ret["ok"] = json!(true);
+                ret.to_string()
+            }
+            Err(err) => json!({"ok": false, "message": err.to_string()}).to_string(),
+        }
+    }
     /// Dispatcher method. See [crate::Db::restore_backup].
     pub fn restore_backup(&self, in_file: impl AsRef<Path>) -> Result<()> {
         match self {
@@ -480,6 +585,33 @@ impl DbInstance {
             DbInstance::TiKv(db) => db.unregister_fixed_rule(name),
         }
     }
+    /// Dispatcher method. See [crate::Db::storage_stats]
+    pub fn storage_stats(&self) -> Result<NamedRows> {
+        match self {
+            DbInstance::Mem(db) => db.storage_stats(),
+            #[cfg(feature = "storage-sqlite")]
+            DbInstance::Sqlite(db) => db.storage_stats(),
+            #[cfg(feature = "storage-rocksdb")]
+            DbInstance::RocksDb(db) => db.storage_stats(),
+            #[cfg(feature = "storage-sled")]
+            DbInstance::Sled(db) => db.storage_stats(),
+            #[cfg(feature = "storage-tikv")]
+            DbInstance::TiKv(db) => db.storage_stats(),
+        }
+    }
+    /// Counters and gauges of the storage engine, with JSON string return value.
+    /// See [crate::Db::storage_stats].
+    pub fn storage_stats_str(&self) -> String {
+        match self.storage_stats() {
+            Ok(named_rows) => {
+                let mut j_val = named_rows.into_json();
+                let map = j_val.as_object_mut().unwrap();
+                map.insert("ok".to_string(), json!(true));
+                j_val.to_string()
+            }
+            Err(err) => json!({"ok": false, "message": err.to_string()}).to_string(),
+        }
+    }
 
     /// Dispatcher method. See [crate::Db::run_multi_transaction]
     pub fn run_multi_transaction(
@@ -566,6 +698,37 @@ impl MultiTransaction {
     }
 }
 
+/// Restore the latest incremental backup made by [crate::Db::incremental_backup] into
+/// `backup_dir` as a new database of the storage engine `engine` at `path`.
+/// Only the `rocksdb` engine supports incremental backups.
+#[allow(unused_variables)]
+pub fn restore_incremental_backup(
+    engine: &str,
+    backup_dir: impl AsRef<Path>,
+    path: impl AsRef<Path>,
+) -> Result<()> {
+    match engine {
+        #[cfg(feature = "storage-rocksdb")]
+        "rocksdb" => restore_cozo_rocksdb_backup(backup_dir, path),
+        k => bail!(
+            "incremental backups are not supported by the {} storage engine",
+            k
+        ),
+    }
+}
+
+/// Same as [restore_incremental_backup], with JSON string return value.
+pub fn restore_incremental_backup_str(
+    engine: &str,
+    backup_dir: impl AsRef<Path>,
+    path: impl AsRef<Path>,
+) -> String {
+    match restore_incremental_backup(engine, backup_dir, path) {
+        Ok(_) => json!({"ok": true}).to_string(),
+        Err(err) => json!({"ok": false, "message": err.to_string()}).to_string(),
+    }
+}
+
 /// Convert error raised by the database into friendly JSON format
 pub fn format_error_as_json(mut err: Report, source: Option<&str>) -> JsonValue {
     if err.source_code().is_none() {
@@ -29,6 +29,7 @@ use crate::{Expr, FixedRule};
 #[derive(Debug)]
 pub(crate) enum SysOp {
     Compact,
+    StorageStats,
     ListColumns(Symbol),
     ListIndices(Symbol),
     ListRelations,
@@ -110,6 +111,7 @@ pub(crate) fn parse_sys(
     let inner = src.next().unwrap();
     Ok(match inner.as_rule() {
         Rule::compact_op => SysOp::Compact,
+        Rule::storage_stats_op => SysOp::StorageStats,
         Rule::running_op => SysOp::ListRunning,
         Rule::kill_op => {
             let i_expr = inner.into_inner().next().unwrap();
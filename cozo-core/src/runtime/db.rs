@@ -35,8 +35,8 @@ use thiserror::Error;
 use crate::data::functions::current_validity;
 use crate::data::json::JsonValue;
 use crate::data::program::{InputProgram, QueryAssertion, RelationOp, ReturnMutation};
-use crate::data::relation::ColumnDef;
-use crate::data::tuple::{Tuple, TupleT};
+use crate::data::relation::{ColType, ColumnDef, NullableColType};
+use crate::data::tuple::{decode_tuple_from_key, Tuple, TupleT};
 use crate::data::value::{DataValue, ValidityTs, LARGEST_UTF_CHAR};
 use crate::fixed_rule::DEFAULT_FIXED_RULES;
 use crate::fts::TokenizerCache;
@@ -56,7 +56,7 @@ use crate::runtime::relation::{
 };
 use crate::runtime::transact::SessionTx;
 use crate::storage::temp::TempStorage;
-use crate::storage::Storage;
+use crate::storage::{Storage, StorageChange};
 use crate::{decode_tuple_from_kv, FixedRule, Symbol};
 
 pub(crate) struct RunningQueryHandle {
@@ -242,6 +242,68 @@ impl NamedRows {
     }
 }
 
+/// A write to a stored relation, read back by [Db::changes_since]
+#[derive(Debug, Clone)]
+pub enum RelationChange {
+    /// A row was put
+    Put {
+        /// Sequence number of the write
+        seq: u64,
+        /// The keys followed by the values
+        row: Tuple,
+    },
+    /// The row with these keys was removed
+    Delete {
+        /// Sequence number of the write
+        seq: u64,
+        /// The keys
+        key: Tuple,
+    },
+    /// Rows were removed in bulk, as when the relation is replaced or removed,
+    /// and the relation needs to be read again
+    Clear {
+        /// Sequence number of the write
+        seq: u64,
+    },
+}
+
+/// Writes to a stored relation, see [Db::changes_since]
+#[derive(Debug, Clone)]
+pub struct RelationChanges {
+    /// The headers of the rows of puts
+    pub headers: Vec<String>,
+    /// The writes, in the order in which they were made
+    pub changes: Vec<RelationChange>,
+    /// The sequence number to continue from
+    pub next: u64,
+}
+
+impl RelationChanges {
+    /// Convert to a JSON object, with the changes as objects with an `op` of `put`, `delete`
+    /// or `clear`, a `seq`, and the row or keys as `row`.
+    pub fn into_json(self) -> JsonValue {
+        let row_json = |row: Tuple| row.into_iter().map(JsonValue::from).collect::<JsonValue>();
+        let changes = self
+            .changes
+            .into_iter()
+            .map(|change| match change {
+                RelationChange::Put { seq, row } => {
+                    json!({"op": "put", "seq": seq, "row": row_json(row)})
+                }
+                RelationChange::Delete { seq, key } => {
+                    json!({"op": "delete", "seq": seq, "row": row_json(key)})
+                }
+                RelationChange::Clear { seq } => json!({"op": "clear", "seq": seq}),
+            })
+            .collect::<JsonValue>();
+        json!({
+            "headers": self.headers,
+            "changes": changes,
+            "next": self.next,
+        })
+    }
+}
+
 const STATUS_STR: &str = "status";
 const OK_STR: &str = "OK";
 
@@ -635,6 +697,139 @@ impl<'s, S: Storage<'s>> Db<S> {
         #[cfg(not(feature = "storage-sqlite"))]
         bail!("backup requires the 'storage-sqlite' feature to be enabled")
     }
+    /// Write a consistent copy of the running database into the directory `dir`, which must
+    /// not exist yet, in the native format of the storage engine. The copy can be opened as a
+    /// database of the same engine. For RocksDB, the data files are hard-linked when `dir` is
+    /// on the same file system, so this only takes seconds whatever the size of the database.
+    pub fn checkpoint(&'s self, dir: impl AsRef<Path>) -> Result<()> {
+        self.db.checkpoint(dir.as_ref())
+    }
+    /// Add an incremental backup of the running database to the backup directory `dir`, which
+    /// only copies the data that earlier backups in `dir` do not have already.
+    /// See [crate::restore_incremental_backup].
+    pub fn incremental_backup(&'s self, dir: impl AsRef<Path>) -> Result<()> {
+        self.db.incremental_backup(dir.as_ref())
+    }
+    /// For a database opened as a secondary instance, make what the primary instance has
+    /// written so far visible to queries.
+    pub fn catch_up_with_primary(&'s self) -> Result<()> {
+        self.db.catch_up_with_primary()?;
+        self.load_last_ids()
+    }
+    /// Garbage-collect the old versions of the rows of the time travel relation `relation` while
+    /// the storage engine compacts its data, without deleting anything. Versions older than
+    /// `retention` are dropped, except the one current at that time, which time travel to that
+    /// time or later still sees. With `expire_current`, this one is dropped too, so that rows
+    /// not asserted or retracted within `retention` disappear. `None` stops collecting.
+    /// The retention only holds until the database is closed.
+    pub fn set_validity_retention(
+        &'s self,
+        relation: &str,
+        retention: Option<Duration>,
+        expire_current: bool,
+    ) -> Result<()> {
+        #[derive(Debug, Error, Diagnostic)]
+        #[error("Stored relation {0} does not support time travel")]
+        #[diagnostic(code(eval::not_time_travel_relation))]
+        #[diagnostic(help("The last key column must be of type 'Validity'"))]
+        struct NotTimeTravelRelation(String);
+
+        let handle = {
+            let tx = self.transact()?;
+            let handle = tx.get_relation(relation, false)?;
+            tx.commit_tx()?;
+            handle
+        };
+        let is_time_travel = handle.metadata.keys.last().map(|col| &col.typing)
+            == Some(&NullableColType {
+                coltype: ColType::Validity,
+                nullable: false,
+            });
+        ensure!(
+            is_time_travel,
+            NotTimeTravelRelation(handle.name.to_string())
+        );
+        self.db
+            .set_validity_retention(handle.id.0, retention, expire_current)
+    }
+    /// Follow the writes to the stored relation `relation` by reading back at most `limit` of
+    /// those made from the sequence number `since` on, without running queries. Also returns the
+    /// sequence number to pass as `since` to get the writes that follow. With a `limit` of `0`,
+    /// only returns the sequence number following the latest write: a follower can take it,
+    /// read the relation once, then follow the writes from it on, as writes seen twice give
+    /// the same rows.
+    /// Writes are kept for `change_feed_retention_secs` with the RocksDB storage engine,
+    /// which is the only one supporting this.
+    pub fn changes_since(
+        &'s self,
+        relation: &str,
+        since: u64,
+        limit: usize,
+    ) -> Result<RelationChanges> {
+        let handle = {
+            let tx = self.transact()?;
+            let handle = tx.get_relation(relation, false)?;
+            tx.commit_tx()?;
+            handle
+        };
+        let lower = Tuple::default().encode_as_key(handle.id);
+        let upper = Tuple::default().encode_as_key(handle.id.next());
+        let (changes, next) = self.db.changes_since(&lower, &upper, since, limit)?;
+        let n_keys = handle.metadata.keys.len();
+        let size_hint = n_keys + handle.metadata.non_keys.len();
+        let changes = changes
+            .into_iter()
+            .map(|change| match change {
+                StorageChange::Put { seq, key, val } => RelationChange::Put {
+                    seq,
+                    row: decode_tuple_from_kv(&key, &val, Some(size_hint)),
+                },
+                StorageChange::Delete { seq, key } => RelationChange::Delete {
+                    seq,
+                    key: decode_tuple_from_key(&key, n_keys),
+                },
+                StorageChange::DeleteRange { seq, .. } => RelationChange::Clear { seq },
+            })
+            .collect();
+        let headers = handle
+            .metadata
+            .keys
+            .iter()
+            .chain(handle.metadata.non_keys.iter())
+            .map(|col| col.name.to_string())
+            .collect();
+        Ok(RelationChanges {
+            headers,
+            changes,
+            next,
+        })
+    }
+    /// Key ranges of the stored relation `relation` and of its indices
+    pub(crate) fn relation_key_ranges(&'s self, relation: &str) -> Result<Vec<(Vec<u8>, Vec<u8>)>> {
+        let handle = {
+            let tx = self.transact()?;
+            let handle = tx.get_relation(relation, false)?;
+            tx.commit_tx()?;
+            handle
+        };
+        let mut ids = vec![handle.id];
+        ids.extend(handle.indices.values().map(|(idx, _)| idx.id));
+        ids.extend(handle.hnsw_indices.values().map(|(idx, _)| idx.id));
+        ids.extend(handle.fts_indices.values().map(|(idx, _)| idx.id));
+        for (idx, inv_idx, _) in handle.lsh_indices.values() {
+            ids.push(idx.id);
+            ids.push(inv_idx.id);
+        }
+        Ok(ids
+            .into_iter()
+            .map(|id| {
+                (
+                    Tuple::default().encode_as_key(id),
+                    Tuple::default().encode_as_key(id.next()),
+                )
+            })
+            .collect())
+    }
     /// Restore from an Sqlite backup
     #[allow(unused_variables)]
     pub fn restore_backup(&'s self, in_file: impl AsRef<Path>) -> Result<()> {
@@ -687,6 +882,7 @@ impl<'s, S: Storage<'s>> Db<S> {
             let source_db = crate::new_cozo_sqlite(in_file)?;
             let mut src_tx = source_db.transact()?;
             let mut dst_tx = self.transact_write()?;
+            let mut targets = vec![];
 
             for relation in relations {
                 if relation.contains(':') {
@@ -713,17 +909,28 @@ impl<'s, S: Storage<'s>> Db<S> {
                     ));
                 }
 
+                targets.push((src_handle, dst_handle));
+            }
+
+            // the keys of each relation are contiguous, so going through the relations
+            // in the order of their ids gives all the data in ascending order
+            targets.sort_by_key(|(_, dst_handle)| dst_handle.id);
+            let data_it = targets.iter().flat_map(|(src_handle, dst_handle)| {
                 let src_lower = Tuple::default().encode_as_key(src_handle.id);
                 let src_upper = Tuple::default().encode_as_key(src_handle.id.next());
 
-                let data_it = src_tx.store_tx.range_scan(&src_lower, &src_upper).map(
-                    |src_pair| -> Result<(Vec<u8>, Vec<u8>)> {
+                src_tx.store_tx.range_scan(&src_lower, &src_upper).map(
+                    move |src_pair| -> Result<(Vec<u8>, Vec<u8>)> {
                         let (mut src_k, mut src_v) = src_pair?;
                         dst_handle.amend_key_prefix(&mut src_k);
                         dst_handle.amend_key_prefix(&mut src_v);
                         Ok((src_k, src_v))
                     },
-                );
+                )
+            });
+            if self.db.supports_bulk_import() {
+                self.db.bulk_import(Box::new(data_it))?;
+            } else {
                 for result in data_it {
                     let (key, val) = result?;
                     dst_tx.store_tx.put(&key, &val)?;
@@ -1211,6 +1418,7 @@ impl<'s, S: Storage<'s>> Db<S> {
                     vec![vec![DataValue::from(OK_STR)]],
                 ))
             }
+            SysOp::StorageStats => self.storage_stats(),
             SysOp::ListRelations => self.list_relations(tx),
             SysOp::ListFixedRules => {
                 let rules = self.fixed_rules.read().unwrap();
@@ -1680,6 +1888,19 @@ impl<'s, S: Storage<'s>> Db<S> {
             }
         }
     }
+    /// Counters and gauges of the storage engine, see [Storage::storage_stats].
+    pub fn storage_stats(&'s self) -> Result<NamedRows> {
+        let rows = self
+            .db
+            .storage_stats()?
+            .into_iter()
+            .map(|(name, value)| vec![DataValue::from(name), value])
+            .collect_vec();
+        Ok(NamedRows::new(
+            vec!["stat".to_string(), "value".to_string()],
+            rows,
+        ))
+    }
     pub(crate) fn list_running(&self) -> Result<NamedRows> {
         let rows = self
             .running_queries
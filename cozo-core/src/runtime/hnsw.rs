@@ -328,13 +328,16 @@ impl<'a> SessionTx<'a> {
                     }
                     let target_self_key_bytes =
                         idx_table.encode_key_for_store(&target_self_key, Default::default())?;
-                    let target_self_val_bytes = match self.store_tx.get(&target_self_key_bytes, false)? {
-                        Some(bytes) => bytes,
-                        None => bail!("Indexed vector not found, this signifies a bug in the index implementation"),
-                    };
-                    let mut target_self_val: Vec<DataValue> =
-                        rmp_serde::from_slice(&target_self_val_bytes[ENCODED_KEY_MIN_LEN..])
-                            .unwrap();
+                    let mut target_self_val: Vec<DataValue> = vec![];
+                    if !self
+                        .store_tx
+                        .get_with(&target_self_key_bytes, false, &mut |bytes| {
+                            target_self_val =
+                                rmp_serde::from_slice(&bytes[ENCODED_KEY_MIN_LEN..]).unwrap();
+                        })?
+                    {
+                        bail!("Indexed vector not found, this signifies a bug in the index implementation")
+                    }
                     let mut target_degree = target_self_val[0].get_float().unwrap() as usize + 1;
                     if target_degree > m_max {
                         // shrink links
@@ -442,14 +445,16 @@ impl<'a> SessionTx<'a> {
                 old_key.push(DataValue::from(old.1 as i64));
                 old_key.push(DataValue::from(old.2 as i64));
                 let old_key_bytes = idx_table.encode_key_for_store(&old_key, Default::default())?;
-                let old_existing_val = match self.store_tx.get(&old_key_bytes, false)? {
-                    Some(bytes) => bytes,
-                    None => {
-                        bail!("Indexed vector not found, this signifies a bug in the index implementation")
-                    }
-                };
-                let old_existing_val: Vec<DataValue> =
-                    rmp_serde::from_slice(&old_existing_val[ENCODED_KEY_MIN_LEN..]).unwrap();
+                let mut old_existing_val: Vec<DataValue> = vec![];
+                if !self
+                    .store_tx
+                    .get_with(&old_key_bytes, false, &mut |bytes| {
+                        old_existing_val =
+                            rmp_serde::from_slice(&bytes[ENCODED_KEY_MIN_LEN..]).unwrap();
+                    })?
+                {
+                    bail!("Indexed vector not found, this signifies a bug in the index implementation")
+                }
                 if old_existing_val[2].get_bool().unwrap() {
                     self.store_tx.del(&old_key_bytes)?;
                 } else {
@@ -390,10 +390,15 @@ impl RelationHandle {
                 .get(&key_data, false)?
                 .map(|val_data| decode_tuple_from_kv(&key_data, &val_data, Some(self.arity()))))
         } else {
-            Ok(tx
-                .store_tx
-                .get(&key_data, false)?
-                .map(|val_data| decode_tuple_from_kv(&key_data, &val_data, Some(self.arity()))))
+            let mut ret = None;
+            tx.store_tx.get_with(&key_data, false, &mut |val_data| {
+                ret = Some(decode_tuple_from_kv(
+                    &key_data,
+                    val_data,
+                    Some(self.arity()),
+                ))
+            })?;
+            Ok(ret)
         }
     }
 
@@ -409,10 +414,11 @@ impl RelationHandle {
                 .get(&key_data, false)?
                 .map(|val_data| rmp_serde::from_slice(&val_data[ENCODED_KEY_MIN_LEN..]).unwrap()))
         } else {
-            Ok(tx
-                .store_tx
-                .get(&key_data, false)?
-                .map(|val_data| rmp_serde::from_slice(&val_data[ENCODED_KEY_MIN_LEN..]).unwrap()))
+            let mut ret = None;
+            tx.store_tx.get_with(&key_data, false, &mut |val_data| {
+                ret = Some(rmp_serde::from_slice(&val_data[ENCODED_KEY_MIN_LEN..]).unwrap())
+            })?;
+            Ok(ret)
         }
     }
 
@@ -1325,16 +1331,35 @@ impl<'a> SessionTx<'a> {
             })
             .collect_vec();
 
-        if self.store_tx.supports_par_put() {
-            for tuple in rel_handle.scan_all(self) {
-                let tuple = tuple?;
-                let extracted = extraction_indices
-                    .iter()
-                    .map(|idx| tuple[*idx].clone())
-                    .collect_vec();
-                let key = idx_handle.encode_key_for_store(&extracted, Default::default())?;
-                self.store_tx.par_put(&key, &[])?;
+        if self.store_tx.supports_par_put() && !rel_handle.is_temp {
+            // the relation is scanned in parts of about the same size, one thread each
+            let lower = Tuple::default().encode_as_key(rel_handle.id);
+            let upper = Tuple::default().encode_as_key(rel_handle.id.next());
+            #[cfg(not(target_arch = "wasm32"))]
+            let n_parts = rayon::current_num_threads();
+            #[cfg(target_arch = "wasm32")]
+            let n_parts = 1;
+            let parts = self.store_tx.split_range(&lower, &upper, n_parts);
+            let populate = |(part_lower, part_upper): &(Vec<u8>, Vec<u8>)| -> Result<()> {
+                for tuple in self.store_tx.range_scan_tuple(part_lower, part_upper) {
+                    let tuple = tuple?;
+                    let extracted = extraction_indices
+                        .iter()
+                        .map(|idx| tuple[*idx].clone())
+                        .collect_vec();
+                    let key = idx_handle.encode_key_for_store(&extracted, Default::default())?;
+                    self.store_tx.par_put(&key, &[])?;
+                }
+                Ok(())
+            };
+            #[cfg(not(target_arch = "wasm32"))]
+            {
+                use rayon::prelude::*;
+                parts.par_iter().map(populate).collect::<Result<()>>()?;
             }
+            #[cfg(target_arch = "wasm32")]
+            parts.iter().map(populate).collect::<Result<()>>()?;
+            self.store_tx.par_flush()?;
         } else {
             let mut existing = TempCollector::default();
             for tuple in rel_handle.scan_all(self) {
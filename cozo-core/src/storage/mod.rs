@@ -6,11 +6,14 @@
  * You can obtain one at https://mozilla.org/MPL/2.0/.
  */
 
+use std::path::Path;
+use std::time::Duration;
+
 use itertools::Itertools;
 use miette::Result;
 
 use crate::data::tuple::Tuple;
-use crate::data::value::ValidityTs;
+use crate::data::value::{DataValue, ValidityTs};
 use crate::decode_tuple_from_kv;
 
 pub(crate) mod mem;
@@ -47,6 +50,119 @@ pub trait Storage<'s>: Send + Sync + Clone {
         &'a self,
         data: Box<dyn Iterator<Item = Result<(Vec<u8>, Vec<u8>)>> + 'a>,
     ) -> Result<()>;
+
+    /// Whether the engine implements [Storage::bulk_import].
+    fn supports_bulk_import(&self) -> bool {
+        false
+    }
+
+    /// Put multiple key-value pairs into the database atomically, bypassing transactions.
+    /// The order data come in is strictly ascending. Unlike [Storage::batch_put], the database
+    /// may be in use, and existing keys are overwritten.
+    /// Only called if [Storage::supports_bulk_import] returns `true`.
+    fn bulk_import<'a>(
+        &'a self,
+        _data: Box<dyn Iterator<Item = Result<(Vec<u8>, Vec<u8>)>> + 'a>,
+    ) -> Result<()> {
+        miette::bail!(
+            "bulk import is not supported by the {} storage engine",
+            self.storage_kind()
+        )
+    }
+
+    /// Write a consistent copy of the database into the directory `dir`, which must not exist yet,
+    /// in the native format of the engine, such that the copy can be opened as a database.
+    fn checkpoint(&'s self, _dir: &Path) -> Result<()> {
+        miette::bail!(
+            "checkpoints are not supported by the {} storage engine",
+            self.storage_kind()
+        )
+    }
+
+    /// Add an incremental backup of the database to the backup directory `dir`,
+    /// in the native format of the engine.
+    fn incremental_backup(&'s self, _dir: &Path) -> Result<()> {
+        miette::bail!(
+            "incremental backups are not supported by the {} storage engine",
+            self.storage_kind()
+        )
+    }
+
+    /// For a database opened as a secondary instance of a database another process has open
+    /// for writing, make the writes of the other process so far visible.
+    fn catch_up_with_primary(&'s self) -> Result<()> {
+        miette::bail!(
+            "secondary instances are not supported by the {} storage engine",
+            self.storage_kind()
+        )
+    }
+
+    /// Drop the versions of the rows of the time travel relation `rel_id` older than `retention`
+    /// when compacting, except the version current at that time unless `expire_current` is set.
+    /// `None` stops dropping them. See [crate::Db::set_validity_retention].
+    fn set_validity_retention(
+        &'s self,
+        _rel_id: u64,
+        _retention: Option<Duration>,
+        _expire_current: bool,
+    ) -> Result<()> {
+        miette::bail!(
+            "validity retention is not supported by the {} storage engine",
+            self.storage_kind()
+        )
+    }
+
+    /// The writes to keys in `[lower, upper)` with sequence numbers from `since` on, at most
+    /// `limit` of them, along with the sequence number to continue from.
+    /// See [crate::Db::changes_since].
+    fn changes_since(
+        &'s self,
+        _lower: &[u8],
+        _upper: &[u8],
+        _since: u64,
+        _limit: usize,
+    ) -> Result<(Vec<StorageChange>, u64)> {
+        miette::bail!(
+            "change feeds are not supported by the {} storage engine",
+            self.storage_kind()
+        )
+    }
+
+    /// Engine-specific counters and gauges, such as cache hit rates and pending compaction work.
+    /// Engines without any return nothing.
+    fn storage_stats(&'s self) -> Result<Vec<(String, DataValue)>> {
+        Ok(vec![])
+    }
+}
+
+/// A write to a storage engine, as read back by [Storage::changes_since]
+#[derive(Debug, Clone)]
+pub enum StorageChange {
+    /// A key was set
+    Put {
+        /// Sequence number of the write
+        seq: u64,
+        /// The key
+        key: Vec<u8>,
+        /// The value
+        val: Vec<u8>,
+    },
+    /// A key was deleted
+    Delete {
+        /// Sequence number of the write
+        seq: u64,
+        /// The key
+        key: Vec<u8>,
+    },
+    /// The keys in a range were deleted
+    DeleteRange {
+        /// Sequence number of the write
+        seq: u64,
+        /// Inclusive start of the range
+        lower: Vec<u8>,
+        /// Exclusive end of the range
+        upper: Vec<u8>,
+    },
 }
 
 /// Trait for the associated transaction type of a storage engine.
@@ -57,6 +173,19 @@ pub trait StoreTx<'s>: Sync {
     /// the key has not been modified outside the transaction.
     fn get(&self, key: &[u8], for_update: bool) -> Result<Option<Vec<u8>>>;
 
+    /// Same as [StoreTx::get], but hands the value to `f` instead of returning it, so that engines
+    /// able to expose values in place do not need to copy them. Returns `false` without calling `f`
+    /// if the key does not exist.
+    fn get_with(&self, key: &[u8], for_update: bool, f: &mut dyn FnMut(&[u8])) -> Result<bool> {
+        match self.get(key, for_update)? {
+            Some(val) => {
+                f(&val);
+                Ok(true)
+            }
+            None => Ok(false),
+        }
+    }
+
     /// Get multiple keys. If `for_update` is `true` (only possible in a write transaction),
     /// then the database needs to guarantee that `commit()` can only succeed if
     /// the keys have not been modified outside the transaction.
@@ -89,6 +218,13 @@ pub trait StoreTx<'s>: Sync {
         panic!("par_del is not supported")
     }
 
+    /// Make the writes of `par_put` and `par_del` visible to the reads of the transaction,
+    /// for engines that buffer them until then. Called once the writing threads are done.
+    /// They are also made visible on commit.
+    fn par_flush(&mut self) -> Result<()> {
+        Ok(())
+    }
+
     /// Delete a range from persisted data only.
     fn del_range_from_persisted(&mut self, lower: &[u8], upper: &[u8]) -> Result<()>;
 
@@ -160,4 +296,12 @@ pub trait StoreTx<'s>: Sync {
     fn total_scan<'a>(&'a self) -> Box<dyn Iterator<Item = Result<(Vec<u8>, Vec<u8>)>> + 'a>
     where
         's: 'a;
+
+    /// Split the range into at most `n` consecutive parts holding about the same amount of data,
+    /// each with its `lower` (inclusive) and `upper` (exclusive) bound, so that the parts can be
+    /// scanned on separate threads, with all scans seeing the same data.
+    /// The default implementation does not split.
+    fn split_range(&self, lower: &[u8], upper: &[u8], _n: usize) -> Vec<(Vec<u8>, Vec<u8>)> {
+        vec![(lower.to_vec(), upper.to_vec())]
+    }
 }
@@ -6,30 +6,324 @@
  * You can obtain one at https://mozilla.org/MPL/2.0/.
  */
 
+use std::cmp::Reverse;
+use std::collections::{BTreeMap, VecDeque};
 use std::fs;
+use std::ops::{Deref, DerefMut};
 use std::path::{Path, PathBuf};
+use std::sync::atomic::AtomicUsize;
+use std::sync::Mutex;
+use std::time::Duration;
 
-use log::info;
-use miette::{miette, IntoDiagnostic, Result, WrapErr};
+use itertools::Itertools;
+use log::{debug, info, log_enabled, warn, Level};
+use miette::{bail, miette, IntoDiagnostic, Result, WrapErr};
 
-use cozorocks::{DbBuilder, DbIter, RocksDb, Tx};
+use cozorocks::{ChangeKind, DbBuilder, DbIter, RocksDb, Tx, WriteStall};
 
-use crate::data::tuple::{check_key_for_validity, Tuple};
-use crate::data::value::ValidityTs;
+use crate::data::functions::TERMINAL_VALIDITY;
+use crate::data::memcmp::MemCmpEncoder;
+use crate::data::tuple::Tuple;
+use crate::data::value::{DataValue, Validity, ValidityTs};
 use crate::runtime::db::{BadDbInit, DbManifest};
-use crate::runtime::relation::{decode_tuple_from_kv, extend_tuple_from_v};
-use crate::storage::{Storage, StoreTx};
+use crate::runtime::relation::decode_tuple_from_kv;
+use crate::storage::{Storage, StorageChange, StoreTx};
 use crate::utils::swap_option_result;
 use crate::Db;
 
 const KEY_PREFIX_LEN: usize = 9;
 const CURRENT_STORAGE_VERSION: u64 = 3;
 
+static BULK_LOAD_SEQ: AtomicUsize = AtomicUsize::new(0);
+
+/// Number of puts written out together by [RocksDbStorage::load_through_write_batches]
+const BATCH_PUT_SIZE: usize = 4096;
+
+/// With debug logging enabled for this target, every transaction collects the RocksDB perf context
+/// of its reads and writes and logs it when it ends, summed per kind of call.
+pub const PERF_LOG_TARGET: &str = "cozo::rocksdb::perf";
+
+/// Options for the RocksDB storage engine.
+/// When opening through [DbInstance::new](crate::DbInstance::new), these are passed
+/// as a JSON object in the `options` argument, and missing fields take their default values.
+#[derive(serde_derive::Deserialize, Debug, Clone, Default)]
+#[serde(default)]
+pub struct RocksDbOptions {
+    /// Size of the block cache in bytes. `0` uses the RocksDB default.
+    pub block_cache_size: usize,
+    /// Use a HyperClockCache instead of an LRU cache as the block cache.
+    pub hyper_clock_cache: bool,
+    /// Databases in the same process opened with the same non-empty name share
+    /// a single block cache, sized by whichever database opens first.
+    pub shared_block_cache: String,
+    /// Size in bytes of a compressed in-memory cache behind the block cache, holding the blocks
+    /// evicted from it, so that the working set is read back from memory rather than from disk.
+    /// `0` for none. Needs a `block_cache_size` and no `hyper_clock_cache`.
+    pub secondary_cache_size: usize,
+    /// Secondary cache given by its URI in the RocksDB object registry instead, such as a cache
+    /// on local SSDs provided by a plugin linked into the program. Takes precedence over
+    /// `secondary_cache_size`.
+    pub secondary_cache_uri: String,
+    /// Data block size of the SST files in bytes. `0` keeps the default of 16 KiB.
+    pub block_size: usize,
+    /// Use Ribbon filters instead of Bloom filters.
+    pub ribbon_filter: bool,
+    /// Use partitioned index and filter blocks.
+    pub partitioned_index_filters: bool,
+    /// Add a hash index to the data blocks to speed up point lookups.
+    pub data_block_hash_index: bool,
+    /// Number of leading key columns that are part of the prefix used by prefix Bloom filters,
+    /// along with the relation id, so that lookups and joins on these columns can skip SST files.
+    /// `0` only uses the relation id.
+    pub prefix_key_columns: usize,
+    /// Store each relation in its own column family, so that relations are compacted separately
+    /// and dropping a relation drops its column family. Only takes effect when the database is created.
+    pub column_family_per_relation: bool,
+    /// Options applied to the column family of each relation, in the RocksDB options string format,
+    /// e.g. `"compaction_style=kCompactionStyleUniversal;enable_blob_files=true"`.
+    pub relation_cf_options: String,
+    /// Use optimistic transactions, which take no locks but fail at commit time
+    /// on conflicts with concurrent writes. Suited to read-mostly workloads with rare write contention.
+    pub optimistic: bool,
+    /// Cap in bytes on the memory taken by the writes a transaction buffers until it commits.
+    /// `0` for no cap. Without `large_transactions`, queries writing more fail.
+    /// Does not apply to `optimistic` transactions.
+    pub transaction_memory_limit: usize,
+    /// Let transactions write what they buffer beyond `transaction_memory_limit` into the
+    /// database before they commit, invisible to other transactions until then, so that
+    /// replacing or putting any number of rows takes bounded memory. Cannot be combined with
+    /// `optimistic`.
+    ///
+    /// This changes the format of the WAL one way: a database that crashed while opened with
+    /// this cannot be recovered without it. Opening a database with this leaves a
+    /// `large_transactions` file in its directory, and the database cannot be opened without
+    /// this any more while the file is there. Only remove the file once the database has been
+    /// closed cleanly.
+    ///
+    /// Writes that would go around the transactions are not possible with this: destroying
+    /// relations deletes their rows one by one, unless they have column families of their own,
+    /// restoring backups writes batches of rows instead of SST files, importing from backups
+    /// goes through transactions, and [Db::changes_since] is not supported.
+    pub large_transactions: bool,
+    /// Open the database faster, by not reading the properties and checking the sizes of all
+    /// the SST files, and by deleting obsolete files in the background.
+    pub fast_open: bool,
+    /// Number of SST files kept open. With a limit, files are opened when first read instead of
+    /// all of them when the database opens, which is much faster for large databases.
+    /// `0` keeps all of them open, which is the RocksDB default of `-1`.
+    pub max_open_files: i32,
+    /// Number of threads opening the SST files when the database opens. `0` uses 16 threads.
+    pub file_opening_threads: i32,
+    /// Stored relations whose files are opened in the background once the database is open,
+    /// loading their index and filter blocks and those of their indices into the block cache,
+    /// while queries already run.
+    pub warm_up_relations: Vec<String>,
+    /// Once a scan has gone through a thousand or so entries, it switches to adaptive readahead,
+    /// prefetching blocks ahead of it. With this, the prefetching is asynchronous, which makes a
+    /// difference when built with the `io-uring` feature.
+    pub scan_async_io: bool,
+    /// Readahead size in bytes of long scans. `0` lets RocksDB grow it automatically.
+    pub scan_readahead_size: usize,
+    /// How restoring backups and importing from backups load data.
+    pub bulk_load: RocksDbBulkLoadOptions,
+    /// Keeping large values in blob files apart from the keys.
+    pub blob: RocksDbBlobOptions,
+    /// Collect the RocksDB statistics tickers reported by `::storage_stats`, including the
+    /// hit rates of the block cache and of the secondary cache.
+    /// This has a small cost on every operation.
+    pub statistics: bool,
+    /// Limit on the rate of flush and compaction writes in bytes per second, so that bursts of
+    /// writes leave IO for reads. `0` for no limit.
+    pub rate_limit_bytes_per_sec: usize,
+    /// Let RocksDB adjust the rate limit to the flush and compaction backlog,
+    /// with `rate_limit_bytes_per_sec` as the upper bound.
+    pub rate_limit_auto_tuned: bool,
+    /// Memory budget in bytes for the memtables of all relations. `0` for no budget.
+    pub write_buffer_budget: usize,
+    /// Charge the memtable memory to the block cache.
+    pub write_buffer_cost_to_cache: bool,
+    /// Databases in the same process opened with the same non-empty name share a single
+    /// memtable budget, sized by whichever database opens first.
+    pub shared_write_buffer_budget: String,
+    /// While RocksDB stalls writes because flushes or compactions cannot keep up, fail writing
+    /// queries right away with an error asking to retry later, instead of blocking them.
+    pub write_stall_backpressure: bool,
+    /// Keep obsolete WAL files for this many seconds, so that change feeds can still read the
+    /// writes in them, see [Db::changes_since]. `0` removes them once flushed, which makes
+    /// change feeds only see writes not flushed yet.
+    pub change_feed_retention_secs: u64,
+    /// Also keep no more than this many megabytes of obsolete WAL files. `0` for no limit.
+    pub change_feed_retention_mb: u64,
+    /// Let the WAL write of a commit overlap with the memtable writes of the commits before it,
+    /// which raises the throughput of many transactions committing at once.
+    pub pipelined_write: bool,
+    /// Number of incremental backups kept in a backup directory, the oldest ones are removed.
+    /// `0` keeps all of them.
+    pub max_backups: u32,
+    /// Open an existing database without writing to it, while another process may have it open.
+    /// Writes made by the other process afterwards are not seen. All queries are read-only.
+    pub read_only: bool,
+    /// Open an existing database as a secondary instance of the process that has it open,
+    /// keeping the info logs of the secondary in this directory. The secondary catches up with
+    /// the writes of the primary every `catch_up_interval_ms`, or on `::catch_up_with_primary`.
+    /// All queries are read-only.
+    pub secondary_path: String,
+    /// Interval between two catch-ups of a secondary with its primary. `0` only catches up on demand.
+    pub catch_up_interval_ms: u64,
+    /// Time travel relations whose old versions of rows are dropped when compacting,
+    /// keyed by relation name, see [Db::set_validity_retention].
+    /// Relations that do not exist when the database opens are skipped.
+    pub validity_retention: BTreeMap<String, RocksDbValidityRetention>,
+}
+
+/// Retention of the old versions of the rows of a time travel relation
+#[derive(serde_derive::Deserialize, Debug, Clone, Default)]
+#[serde(default)]
+pub struct RocksDbValidityRetention {
+    /// Versions older than this many seconds are dropped, but for the one current at that time.
+    pub retention_secs: u64,
+    /// Drop the version current at that time too.
+    pub expire_current: bool,
+}
+
+/// Options for storing large values in blob files, so that compactions rewrite only keys
+/// and references to values, instead of the values themselves. Small values, such as those of
+/// edges, stay in the SST files next to their keys. With `column_family_per_relation`, a relation
+/// can also have its own blob settings through `relation_cf_options`.
+#[derive(serde_derive::Deserialize, Debug, Clone)]
+#[serde(default)]
+pub struct RocksDbBlobOptions {
+    /// Store values of at least `min_size` bytes in blob files.
+    pub enabled: bool,
+    /// Values smaller than this many bytes stay in the SST files.
+    pub min_size: usize,
+    /// Target size in bytes of each blob file.
+    pub file_size: usize,
+    /// Compression of the blob files, one of `none`, `snappy`, `zlib`, `lz4`, `lz4hc` and `zstd`.
+    pub compression: String,
+    /// Rewrite the live values of old blob files during compactions, so that the files can be removed.
+    pub garbage_collection: bool,
+    /// Fraction of the oldest blob files whose values are rewritten by garbage collection.
+    pub garbage_collection_age_cutoff: f64,
+    /// Only separate values written into this level of the LSM tree or below, so that values
+    /// overwritten soon after being written never make it to blob files.
+    pub file_starting_level: i32,
+    /// Size in bytes of the cache of large values, which is separate from the block cache
+    /// so that large values do not evict index and data blocks. `0` for no cache.
+    pub cache_size: usize,
+    /// Databases in the same process opened with the same non-empty name share a single
+    /// blob cache, sized by whichever database opens first.
+    pub shared_cache: String,
+    /// Put the values written by flushes into the cache.
+    pub prepopulate_cache: bool,
+}
+
+impl Default for RocksDbBlobOptions {
+    fn default() -> Self {
+        Self {
+            enabled: false,
+            min_size: 4096,
+            file_size: 256 << 20,
+            compression: "lz4".to_string(),
+            garbage_collection: true,
+            garbage_collection_age_cutoff: 0.25,
+            file_starting_level: 0,
+            cache_size: 0,
+            shared_cache: "".to_string(),
+            prepopulate_cache: false,
+        }
+    }
+}
+
+/// Options for loading data in bulk. The sorted input is cut into chunks that are written into
+/// SST files by a pool of threads, and all the files are then ingested atomically in a single call.
+/// Backups restored with less than `file_size` bytes of data are written with write batches instead.
+#[derive(serde_derive::Deserialize, Debug, Clone)]
+#[serde(default)]
+pub struct RocksDbBulkLoadOptions {
+    /// Number of threads writing SST files. `0` uses one thread per available core.
+    pub threads: usize,
+    /// Approximate size in bytes of the data in each SST file.
+    pub file_size: usize,
+    /// Hard-link the SST files into the database instead of copying them.
+    pub move_files: bool,
+    /// Allow the ingested data to overlap with existing data. Without this, loading fails
+    /// when there is overlapping data.
+    pub allow_global_seqno: bool,
+}
+
+impl Default for RocksDbBulkLoadOptions {
+    fn default() -> Self {
+        Self {
+            threads: 0,
+            file_size: 64 << 20,
+            move_files: true,
+            allow_global_seqno: true,
+        }
+    }
+}
+
+/// Marks a database directory as opened with `large_transactions`, see [RocksDbOptions::large_transactions]
+const LARGE_TRANSACTIONS_MARKER: &str = "large_transactions";
+
+/// Files of a database directory besides the RocksDB data, which go along with checkpoints and backups
+const DB_DIR_FILES: [&str; 3] = ["manifest", "options", LARGE_TRANSACTIONS_MARKER];
+
+fn copy_db_dir_files(from: &Path, to: &Path) -> Result<()> {
+    for name in DB_DIR_FILES {
+        let src = from.join(name);
+        if src.exists() {
+            fs::copy(&src, to.join(name))
+                .into_diagnostic()
+                .wrap_err_with(|| format!("when copying {}", src.to_string_lossy()))?;
+        }
+    }
+    Ok(())
+}
+
+/// Restores the latest incremental backup made into `backup_dir` as a new database at `path`.
+pub fn restore_cozo_rocksdb_backup(
+    backup_dir: impl AsRef<Path>,
+    path: impl AsRef<Path>,
+) -> Result<()> {
+    let backup_dir = backup_dir.as_ref();
+    let path = path.as_ref();
+    if path.join("manifest").exists() {
+        bail!(
+            "Cannot restore backup: a database already exists at {}",
+            path.to_string_lossy()
+        );
+    }
+    fs::create_dir_all(path).into_diagnostic()?;
+    copy_db_dir_files(backup_dir, path)?;
+    let backup_dir = backup_dir
+        .to_str()
+        .ok_or_else(|| miette!("bad path name"))?;
+    let data_path = path.join("data");
+    let data_path = data_path.to_str().ok_or_else(|| miette!("bad path name"))?;
+    cozorocks::restore_from_backup(backup_dir, data_path).into_diagnostic()
+}
+
 /// Creates a RocksDB database object.
 /// This is currently the fastest persistent storage and it can
 /// sustain huge concurrency.
 /// Supports concurrent readers and writers.
 pub fn new_cozo_rocksdb(path: impl AsRef<Path>) -> Result<Db<RocksDbStorage>> {
+    new_cozo_rocksdb_with_options(path, RocksDbOptions::default())
+}
+
+/// Same as [new_cozo_rocksdb], with engine options.
+pub fn new_cozo_rocksdb_with_options(
+    path: impl AsRef<Path>,
+    opts: RocksDbOptions,
+) -> Result<Db<RocksDbStorage>> {
+    let read_only = opts.read_only || !opts.secondary_path.is_empty();
+    if read_only && !path.as_ref().join("manifest").exists() {
+        bail!(
+            "Cannot open {} read-only: no database exists there",
+            path.as_ref().to_string_lossy()
+        );
+    }
     let builder = DbBuilder::default().path(path.as_ref());
     fs::create_dir_all(path.as_ref()).map_err(|err| {
         BadDbInit(format!(
@@ -74,6 +368,23 @@ pub fn new_cozo_rocksdb(path: impl AsRef<Path>) -> Result<Db<RocksDbStorage>> {
         }
     };
 
+    let marker_path = path_buf.join(LARGE_TRANSACTIONS_MARKER);
+    if opts.large_transactions {
+        // written before the WAL can take any unprepared data
+        if !read_only && !marker_path.exists() {
+            fs::write(&marker_path, b"")
+                .into_diagnostic()
+                .wrap_err_with(|| "when writing the large transactions marker")?;
+        }
+    } else if marker_path.exists() {
+        bail!(
+            "Cannot open {} without `large_transactions`: it has been opened with them. \
+            Once it has been closed cleanly with them, {} can be removed to open it without.",
+            path.as_ref().to_string_lossy(),
+            marker_path.to_string_lossy()
+        );
+    }
+
     let mut store_path = path_buf.clone();
     store_path.push("data");
 
@@ -99,26 +410,311 @@ pub fn new_cozo_rocksdb(path: impl AsRef<Path>) -> Result<Db<RocksDbStorage>> {
     let db_builder = builder
         .create_if_missing(is_new)
         .use_capped_prefix_extractor(true, KEY_PREFIX_LEN)
+        .use_key_columns_prefix_extractor(opts.prefix_key_columns > 0, opts.prefix_key_columns)
         .use_bloom_filter(true, 9.9, true)
+        .use_ribbon_filter(opts.ribbon_filter, 9.9, true)
+        .table_block_size(opts.block_size)
+        .partitioned_index_filters(opts.partitioned_index_filters)
+        .data_block_hash_index(opts.data_block_hash_index, 0.75)
+        .block_cache(opts.block_cache_size, opts.hyper_clock_cache)
+        .shared_block_cache(&opts.shared_block_cache)
+        .secondary_cache(opts.secondary_cache_size)
+        .secondary_cache_uri(&opts.secondary_cache_uri)
+        .enable_blob_files(
+            opts.blob.enabled,
+            opts.blob.min_size,
+            opts.blob.file_size,
+            opts.blob.garbage_collection,
+        )
+        .blob_garbage_collection(
+            opts.blob.garbage_collection_age_cutoff,
+            opts.blob.file_starting_level,
+        )
+        .blob_compression(if opts.blob.enabled {
+            &opts.blob.compression
+        } else {
+            ""
+        })
+        .blob_cache(opts.blob.cache_size, opts.blob.prepopulate_cache)
+        .shared_blob_cache(&opts.blob.shared_cache)
+        .relation_column_families(
+            opts.column_family_per_relation && is_new,
+            &opts.relation_cf_options,
+        )
+        .optimistic_transactions(opts.optimistic)
+        .tx_write_buffer_limit(opts.transaction_memory_limit)
+        .large_transactions(opts.large_transactions)
+        .enable_statistics(opts.statistics)
+        .rate_limit(opts.rate_limit_bytes_per_sec, opts.rate_limit_auto_tuned)
+        .write_buffer_budget(opts.write_buffer_budget, opts.write_buffer_cost_to_cache)
+        .shared_write_buffer_budget(&opts.shared_write_buffer_budget)
+        .pipelined_write(opts.pipelined_write)
+        .wal_retention(
+            opts.change_feed_retention_secs,
+            opts.change_feed_retention_mb,
+        )
+        .fast_open(opts.fast_open)
+        .open_files(opts.max_open_files, opts.file_opening_threads)
+        .read_only(opts.read_only)
+        .secondary(&opts.secondary_path)
         .path(store_path)
         .options_path(options_path);
 
     let db = db_builder.build()?;
+    if !opts.secondary_path.is_empty() && opts.catch_up_interval_ms > 0 {
+        spawn_catch_up_thread(&db, opts.catch_up_interval_ms);
+    }
 
-    let ret = Db::new(RocksDbStorage::new(db))?;
+    let mut bulk_load_path = path_buf.clone();
+    bulk_load_path.push("bulk_load");
+
+    let storage = RocksDbStorage {
+        db,
+        path: path_buf,
+        max_backups: opts.max_backups,
+        bulk_load: opts.bulk_load,
+        bulk_load_path,
+        scan_async_io: opts.scan_async_io,
+        scan_readahead_size: opts.scan_readahead_size,
+        write_stall_backpressure: opts.write_stall_backpressure,
+        large_transactions: opts.large_transactions,
+    };
+    let ret = Db::new(storage)?;
     ret.initialize()?;
+    for (relation, retention) in &opts.validity_retention {
+        let result = ret.set_validity_retention(
+            relation,
+            Some(Duration::from_secs(retention.retention_secs)),
+            retention.expire_current,
+        );
+        if let Err(err) = result {
+            warn!("validity retention of {} not set: {}", relation, err);
+        }
+    }
+    let mut warm_up_ranges = vec![];
+    for relation in &opts.warm_up_relations {
+        match ret.relation_key_ranges(relation) {
+            Ok(ranges) => warm_up_ranges.extend(ranges),
+            Err(err) => warn!("relation {} not warmed up: {}", relation, err),
+        }
+    }
+    if !warm_up_ranges.is_empty() {
+        spawn_warm_up_thread(&ret.db.db, warm_up_ranges);
+    }
     Ok(ret)
 }
 
+/// Warms up the ranges one after the other, stopping early if the database is dropped
+fn spawn_warm_up_thread(db: &RocksDb, ranges: Vec<(Vec<u8>, Vec<u8>)>) {
+    let db = db.downgrade();
+    std::thread::spawn(move || {
+        for (lower, upper) in ranges {
+            match db.upgrade() {
+                None => break,
+                Some(db) => {
+                    if let Err(err) = db.warm_up(&lower, &upper) {
+                        warn!("cannot warm up the database: {}", err);
+                        break;
+                    }
+                }
+            }
+        }
+    });
+}
+
+/// Catches up with the primary on a timer, until the secondary is dropped
+fn spawn_catch_up_thread(db: &RocksDb, interval_ms: u64) {
+    let db = db.downgrade();
+    let interval = Duration::from_millis(interval_ms);
+    std::thread::spawn(move || loop {
+        std::thread::sleep(interval);
+        match db.upgrade() {
+            None => break,
+            Some(db) => {
+                if let Err(err) = db.catch_up_with_primary() {
+                    warn!("cannot catch up with the primary: {}", err);
+                }
+            }
+        }
+    });
+}
+
 /// RocksDB storage engine
 #[derive(Clone)]
 pub struct RocksDbStorage {
     db: RocksDb,
+    path: PathBuf,
+    max_backups: u32,
+    bulk_load: RocksDbBulkLoadOptions,
+    bulk_load_path: PathBuf,
+    scan_async_io: bool,
+    scan_readahead_size: usize,
+    write_stall_backpressure: bool,
+    large_transactions: bool,
 }
 
 impl RocksDbStorage {
-    pub(crate) fn new(db: RocksDb) -> Self {
-        Self { db }
+    /// Loads `data` through SST files, unless all of it fits into a single file: writing and
+    /// ingesting files has a fixed cost that write batches are cheaper than for small inputs.
+    fn load<'a>(
+        &'a self,
+        mut data: Box<dyn Iterator<Item = Result<(Vec<u8>, Vec<u8>)>> + 'a>,
+    ) -> Result<()> {
+        let mut head = vec![];
+        let mut head_size = 0;
+        while head_size < self.bulk_load.file_size {
+            match data.next() {
+                None => return self.load_through_write_batches(head.into_iter().map(Ok)),
+                Some(result) => {
+                    let (key, val) = result?;
+                    head_size += key.len() + val.len();
+                    head.push((key, val));
+                }
+            }
+        }
+        self.load_through_sst_files(Box::new(head.into_iter().map(Ok).chain(data)))
+    }
+
+    /// Writes `data` with write batches of [BATCH_PUT_SIZE] puts, outside of transactions.
+    fn load_through_write_batches(
+        &self,
+        data: impl Iterator<Item = Result<(Vec<u8>, Vec<u8>)>>,
+    ) -> Result<()> {
+        let mut writer = self.db.batch_writer(BATCH_PUT_SIZE);
+        for result in data {
+            let (key, val) = result?;
+            writer.put(&key, &val)?;
+        }
+        writer.flush()?;
+        Ok(())
+    }
+
+    /// Writes `data`, which must be in strictly ascending order, into SST files on a pool of threads
+    /// and ingests them all at once. Nothing is visible until every file has been written.
+    fn load_through_sst_files<'a>(
+        &'a self,
+        data: Box<dyn Iterator<Item = Result<(Vec<u8>, Vec<u8>)>> + 'a>,
+    ) -> Result<()> {
+        let threads = match self.bulk_load.threads {
+            0 => std::thread::available_parallelism()
+                .map(|n| n.get())
+                .unwrap_or(1),
+            n => n,
+        };
+        let mut dir = self.bulk_load_path.clone();
+        dir.push(format!(
+            "{}",
+            BULK_LOAD_SEQ.fetch_add(1, std::sync::atomic::Ordering::Relaxed)
+        ));
+        fs::create_dir_all(&dir)
+            .into_diagnostic()
+            .wrap_err_with(|| format!("cannot create directory {}", dir.to_string_lossy()))?;
+
+        let result = self.write_sst_files(data, threads, &dir).and_then(|paths| {
+            if paths.is_empty() {
+                return Ok(());
+            }
+            self.db
+                .ingest_sst_files(
+                    &paths,
+                    self.bulk_load.move_files,
+                    self.bulk_load.allow_global_seqno,
+                )
+                .into_diagnostic()
+        });
+        let _ = fs::remove_dir_all(&dir);
+        result
+    }
+
+    fn write_sst_files<'a>(
+        &'a self,
+        data: Box<dyn Iterator<Item = Result<(Vec<u8>, Vec<u8>)>> + 'a>,
+        threads: usize,
+        dir: &Path,
+    ) -> Result<Vec<String>> {
+        // with column families per relation, a file must not hold more than one relation
+        let split_relations = self.db.uses_relation_cfs();
+        let (sender, receiver) =
+            crossbeam::channel::bounded::<(usize, Vec<(Vec<u8>, Vec<u8>)>)>(threads);
+
+        std::thread::scope(|s| {
+            let workers = (0..threads)
+                .map(|_| {
+                    let receiver = receiver.clone();
+                    s.spawn(move || -> Result<Vec<(usize, String)>> {
+                        let mut written = vec![];
+                        for (idx, chunk) in receiver {
+                            let mut path = dir.to_path_buf();
+                            path.push(format!("{idx:08}.sst"));
+                            let path = path
+                                .to_str()
+                                .ok_or_else(|| miette!("bad path name"))?
+                                .to_string();
+                            let mut writer = self.db.get_sst_writer(&path)?;
+                            for (key, val) in &chunk {
+                                writer.put(key, val)?;
+                            }
+                            writer.finish()?;
+                            written.push((idx, path));
+                        }
+                        Ok(written)
+                    })
+                })
+                .collect::<Vec<_>>();
+            drop(receiver);
+
+            let produce = || -> Result<()> {
+                let mut chunk: Vec<(Vec<u8>, Vec<u8>)> = vec![];
+                let mut chunk_size = 0;
+                let mut idx = 0;
+                for result in data {
+                    let (key, val) = result?;
+                    if let Some((last, _)) = chunk.last() {
+                        if chunk_size >= self.bulk_load.file_size
+                            || (split_relations && last.get(..8) != key.get(..8))
+                        {
+                            if sender.send((idx, std::mem::take(&mut chunk))).is_err() {
+                                // all workers are gone, their errors are reported below
+                                return Ok(());
+                            }
+                            idx += 1;
+                            chunk_size = 0;
+                        }
+                    }
+                    chunk_size += key.len() + val.len();
+                    chunk.push((key, val));
+                }
+                if !chunk.is_empty() {
+                    let _ = sender.send((idx, chunk));
+                }
+                Ok(())
+            };
+            let produced = produce();
+            drop(sender);
+
+            let mut paths = vec![];
+            for worker in workers {
+                let written = worker
+                    .join()
+                    .map_err(|_| miette!("SST writer thread panicked"))??;
+                paths.extend(written);
+            }
+            produced?;
+            paths.sort_unstable();
+            Ok(paths.into_iter().map(|(_, path)| path).collect())
+        })
+    }
+
+    /// Estimated size in bytes taken on disk and in the memtables by the keys in `[lower, upper)`.
+    /// Nothing is read, so this is cheap even for huge ranges.
+    pub fn approximate_range_size(&self, lower: &[u8], upper: &[u8]) -> u64 {
+        self.db.approximate_size(lower, upper, true)
+    }
+
+    /// Estimated number of entries in `[lower, upper)` that have not been flushed to disk yet,
+    /// together with their size in bytes.
+    pub fn approximate_unflushed_range_stats(&self, lower: &[u8], upper: &[u8]) -> (u64, u64) {
+        self.db.approximate_memtable_stats(lower, upper)
     }
 }
 
@@ -129,9 +725,33 @@ impl Storage<'_> for RocksDbStorage {
         "rocksdb"
     }
 
-    fn transact(&self, _write: bool) -> Result<Self::Tx> {
-        let db_tx = self.db.transact().set_snapshot(true).start();
-        Ok(RocksDbTx { db_tx })
+    fn transact(&self, write: bool) -> Result<Self::Tx> {
+        let mut db_tx = if write {
+            if self.write_stall_backpressure && self.db.write_stall() == WriteStall::Stopped {
+                bail!("writes are stalled until compactions catch up, try again later");
+            }
+            self.db
+                .transact()
+                .set_snapshot(true)
+                .no_slowdown(self.write_stall_backpressure)
+                .start()
+        } else {
+            self.db.transact_read_only()
+        };
+        let perf_stats = log_enabled!(target: PERF_LOG_TARGET, Level::Debug);
+        if perf_stats {
+            db_tx.enable_perf_stats();
+        }
+        Ok(RocksDbTx {
+            idle_iters: Mutex::new(vec![]),
+            db_tx,
+            perf_stats,
+            relation_cfs: self.db.uses_relation_cfs(),
+            scan_async_io: self.scan_async_io,
+            scan_readahead_size: self.scan_readahead_size,
+            large_transactions: self.large_transactions,
+            db: self.db.clone(),
+        })
     }
 
     fn range_compact(&self, lower: &[u8], upper: &[u8]) -> Result<()> {
@@ -142,29 +762,300 @@ impl Storage<'_> for RocksDbStorage {
         &'a self,
         data: Box<dyn Iterator<Item = Result<(Vec<u8>, Vec<u8>)>> + 'a>,
     ) -> Result<()> {
-        for result in data {
-            let (key, val) = result?;
-            self.db.raw_put(&key, &val)?;
+        if self.large_transactions {
+            // SST files cannot be ingested
+            return self.load_through_write_batches(data);
+        }
+        self.load(data)
+    }
+
+    fn supports_bulk_import(&self) -> bool {
+        !self.large_transactions
+    }
+
+    fn bulk_import<'a>(
+        &'a self,
+        data: Box<dyn Iterator<Item = Result<(Vec<u8>, Vec<u8>)>> + 'a>,
+    ) -> Result<()> {
+        self.load_through_sst_files(data)
+    }
+
+    fn checkpoint(&self, dir: &Path) -> Result<()> {
+        if dir.exists() {
+            bail!(
+                "Cannot create checkpoint: {} already exists",
+                dir.to_string_lossy()
+            );
+        }
+        fs::create_dir_all(dir).into_diagnostic()?;
+        copy_db_dir_files(&self.path, dir)?;
+        let data_path = dir.join("data");
+        let data_path = data_path.to_str().ok_or_else(|| miette!("bad path name"))?;
+        self.db.checkpoint(data_path).into_diagnostic()
+    }
+
+    fn incremental_backup(&self, dir: &Path) -> Result<()> {
+        fs::create_dir_all(dir).into_diagnostic()?;
+        copy_db_dir_files(&self.path, dir)?;
+        let dir = dir.to_str().ok_or_else(|| miette!("bad path name"))?;
+        self.db
+            .create_backup(dir, self.max_backups)
+            .into_diagnostic()
+    }
+
+    fn set_validity_retention(
+        &self,
+        rel_id: u64,
+        retention: Option<Duration>,
+        expire_current: bool,
+    ) -> Result<()> {
+        match retention {
+            None => self.db.clear_validity_retention(rel_id),
+            Some(retention) => self
+                .db
+                .set_validity_retention(rel_id, retention, expire_current),
         }
         Ok(())
     }
+
+    fn catch_up_with_primary(&self) -> Result<()> {
+        self.db.catch_up_with_primary().into_diagnostic()
+    }
+
+    fn changes_since(
+        &self,
+        lower: &[u8],
+        upper: &[u8],
+        since: u64,
+        limit: usize,
+    ) -> Result<(Vec<StorageChange>, u64)> {
+        let (records, next) = self
+            .db
+            .changes_since(since, lower, upper, limit)
+            .into_diagnostic()?;
+        let changes = records
+            .into_iter()
+            .filter_map(|record| match record.kind {
+                ChangeKind::Put => Some(StorageChange::Put {
+                    seq: record.seq,
+                    key: record.key,
+                    val: record.value,
+                }),
+                ChangeKind::Delete => Some(StorageChange::Delete {
+                    seq: record.seq,
+                    key: record.key,
+                }),
+                ChangeKind::DeleteRange => Some(StorageChange::DeleteRange {
+                    seq: record.seq,
+                    lower: record.key,
+                    upper: record.value,
+                }),
+                // merges are never written by queries
+                _ => None,
+            })
+            .collect();
+        Ok((changes, next))
+    }
+
+    fn storage_stats(&self) -> Result<Vec<(String, DataValue)>> {
+        let stats = self.db.stats();
+        let ticker = |name: &str| {
+            stats
+                .iter()
+                .find(|(n, _)| n == name)
+                .map(|(_, v)| *v)
+                .unwrap_or(0)
+        };
+        let hits = ticker("rocksdb.block.cache.hit");
+        let misses = ticker("rocksdb.block.cache.miss");
+        let mut ret = Vec::with_capacity(stats.len() + 1);
+        if hits + misses > 0 {
+            ret.push((
+                "block_cache_hit_rate".to_string(),
+                DataValue::from(hits as f64 / (hits + misses) as f64),
+            ));
+        }
+        ret.extend(
+            stats
+                .into_iter()
+                .map(|(name, value)| (name, DataValue::from(value as i64))),
+        );
+        Ok(ret)
+    }
 }
 
 pub struct RocksDbTx {
+    // iterators of finished scans, reused by the next ones. Declared before `db_tx`,
+    // as the iterators must be destroyed before the transaction they read from.
+    idle_iters: Mutex<Vec<DbIter>>,
     db_tx: Tx,
+    // whether `db_tx` collects perf stats, logged on drop
+    perf_stats: bool,
+    relation_cfs: bool,
+    scan_async_io: bool,
+    scan_readahead_size: usize,
+    // ranges cannot be deleted outside of write-unprepared transactions, which also only write
+    // what they buffer into the database while they have no live iterators, so these are not pooled
+    large_transactions: bool,
+    // declared last, as the transaction must be destroyed before the database
+    db: RocksDb,
+}
+
+const MAX_IDLE_ITERS: usize = 16;
+
+/// Number of keys read at a time by [RocksDbTx::del_keys_in_range]
+const DEL_RANGE_BATCH: usize = 1024;
+
+impl Drop for RocksDbTx {
+    fn drop(&mut self) {
+        if self.perf_stats {
+            let stats = self.db_tx.perf_stats();
+            if !stats.is_empty() {
+                debug!(
+                    target: PERF_LOG_TARGET,
+                    "{}",
+                    stats
+                        .iter()
+                        .map(|(name, value)| format!("{name}={value}"))
+                        .join(" ")
+                );
+            }
+        }
+    }
 }
 
+// Shared by the threads of parallel rule evaluation, which read through the transaction
+// and write with `par_put` and `par_del` into batches of their own. Write-unprepared transactions
+// keep an unsynchronized list of their iterators, which the bridge creates and destroys under a lock.
 unsafe impl Sync for RocksDbTx {}
 
+impl RocksDbTx {
+    /// With column families per relation, a single iterator cannot cross from one relation
+    /// into another, so `[lower, upper)` is split into parts that each stay within one
+    /// column family. Parts read from the column family of a relation carry its id.
+    fn split_by_relation_cf(
+        &self,
+        lower: &[u8],
+        upper: &[u8],
+    ) -> Vec<(Vec<u8>, Vec<u8>, Option<u64>)> {
+        let mut parts = vec![];
+        let mut cursor = lower.to_vec();
+        if self.relation_cfs {
+            for rel_id in self.db_tx.relation_cfs_in_range(lower, upper) {
+                let rel_lower = rel_id.to_be_bytes().to_vec();
+                let rel_upper = (rel_id + 1).to_be_bytes().to_vec();
+                if cursor < rel_lower {
+                    parts.push((cursor, rel_lower.clone(), None));
+                    cursor = rel_lower;
+                }
+                let part_upper = if rel_upper.as_slice() < upper {
+                    rel_upper
+                } else {
+                    upper.to_vec()
+                };
+                parts.push((cursor, part_upper.clone(), Some(rel_id)));
+                cursor = part_upper;
+            }
+        }
+        if cursor.as_slice() < upper {
+            parts.push((cursor, upper.to_vec(), None));
+        }
+        parts
+    }
+
+    /// An iterator over `[lower, upper)` positioned at `lower`. Short scans are frequent,
+    /// e.g. in nested-loop joins, so iterators are reused instead of created for each scan.
+    fn iter(&self, lower: &[u8], upper: &[u8]) -> PooledIter<'_> {
+        let idle = self.idle_iters.lock().unwrap().pop();
+        let inner = match idle {
+            Some(mut inner) => {
+                inner.retarget(lower, upper);
+                inner
+            }
+            None => {
+                let mut inner = self
+                    .db_tx
+                    .iterator()
+                    .lower_bound(lower)
+                    .upper_bound(upper)
+                    .start();
+                inner.seek(lower);
+                inner
+            }
+        };
+        PooledIter {
+            tx: self,
+            inner: Some(inner),
+        }
+    }
+
+    /// Deletes the keys in `[lower, upper)` one by one through the transaction
+    fn del_keys_in_range(&mut self, lower: &[u8], upper: &[u8]) -> Result<()> {
+        let mut cursor = lower.to_vec();
+        loop {
+            // the iterator is gone before the deletes, so that the transaction can write them out
+            let keys = self
+                .scan_raw_part(&cursor, upper)
+                .take(DEL_RANGE_BATCH)
+                .map(|result| result.map(|(key, _)| key))
+                .collect::<Result<Vec<_>>>()?;
+            let last = match keys.last() {
+                None => return Ok(()),
+                Some(last) => last.clone(),
+            };
+            for key in &keys {
+                self.db_tx.del(key)?;
+            }
+            // the smallest key after the last one deleted
+            cursor = last;
+            cursor.push(0);
+        }
+    }
+
+    fn scan_tuple_part(&self, lower: &[u8], upper: &[u8]) -> RocksDbIterator<'_, Tuple> {
+        RocksDbIterator::new(self.iter(lower, upper), |k, v| {
+            decode_tuple_from_kv(k, v, None)
+        })
+    }
+
+    fn scan_raw_part(&self, lower: &[u8], upper: &[u8]) -> RocksDbIterator<'_, (Vec<u8>, Vec<u8>)> {
+        RocksDbIterator::new(self.iter(lower, upper), |k, v| (k.to_vec(), v.to_vec()))
+    }
+}
+
 impl<'s> StoreTx<'s> for RocksDbTx {
     #[inline]
     fn get(&self, key: &[u8], for_update: bool) -> Result<Option<Vec<u8>>> {
         Ok(self.db_tx.get(key, for_update)?.map(|v| v.to_vec()))
     }
 
+    #[inline]
+    fn get_with(&self, key: &[u8], for_update: bool, f: &mut dyn FnMut(&[u8])) -> Result<bool> {
+        match self.db_tx.get_pinned(key, for_update)? {
+            Some(val) => {
+                f(&val);
+                Ok(true)
+            }
+            None => Ok(false),
+        }
+    }
+
+    fn multi_get(&self, keys: &[Vec<u8>], for_update: bool) -> Result<Vec<Option<Vec<u8>>>> {
+        let found = self.db_tx.multi_get(keys, for_update);
+        (0..found.len())
+            .map(|i| Ok(found.get(i)?.map(|v| v.to_vec())))
+            .collect()
+    }
+
     #[inline]
     fn put(&mut self, key: &[u8], val: &[u8]) -> Result<()> {
-        Ok(self.db_tx.put(key, val)?)
+        match self.db_tx.put(key, val) {
+            Ok(()) => Ok(()),
+            Err(status) if status.is_memory_limit() => Err(status).wrap_err(
+                "transaction writes more than `transaction_memory_limit` allows, see `large_transactions`",
+            ),
+            Err(status) => Err(status.into()),
+        }
     }
 
     fn supports_par_put(&self) -> bool {
@@ -173,7 +1064,11 @@ impl<'s> StoreTx<'s> for RocksDbTx {
 
     #[inline]
     fn par_put(&self, key: &[u8], val: &[u8]) -> Result<()> {
-        Ok(self.db_tx.put(key, val)?)
+        Ok(self.db_tx.par_put(key, val)?)
+    }
+
+    fn par_flush(&mut self) -> Result<()> {
+        Ok(self.db_tx.par_flush()?)
     }
 
     #[inline]
@@ -183,18 +1078,26 @@ impl<'s> StoreTx<'s> for RocksDbTx {
 
     #[inline]
     fn par_del(&self, key: &[u8]) -> Result<()> {
-        Ok(self.db_tx.del(key)?)
+        Ok(self.db_tx.par_del(key)?)
     }
 
     fn del_range_from_persisted(&mut self, lower: &[u8], upper: &[u8]) -> Result<()> {
-        let mut inner = self.db_tx.iterator().upper_bound(upper).start();
-        inner.seek(lower);
-        while let Some(key) = inner.key()? {
-            if key >= upper {
-                break;
+        for (part_lower, part_upper, relation_cf) in self.split_by_relation_cf(lower, upper) {
+            if let Some(rel_id) = relation_cf {
+                // the whole relation is going away: drop its column family instead of deleting each key
+                if part_lower.as_slice() <= rel_id.to_be_bytes().as_slice()
+                    && part_upper.as_slice() >= (rel_id + 1).to_be_bytes().as_slice()
+                {
+                    self.db_tx.drop_relation_cf_on_commit(rel_id);
+                    continue;
+                }
             }
-            self.db_tx.del(key)?;
-            inner.next();
+            if self.large_transactions {
+                self.del_keys_in_range(&part_lower, &part_upper)?;
+                continue;
+            }
+            // the range belongs to a destroyed relation, whose id is never reused
+            self.db_tx.del_range_on_commit(&part_lower, &part_upper);
         }
         Ok(())
     }
@@ -205,24 +1108,34 @@ impl<'s> StoreTx<'s> for RocksDbTx {
     }
 
     fn commit(&mut self) -> Result<()> {
-        Ok(self.db_tx.commit()?)
+        match self.db_tx.commit() {
+            Ok(()) => Ok(()),
+            Err(status) if status.is_conflict() => Err(status).wrap_err(
+                "transaction conflicts with a concurrent write and has been aborted, it can be retried",
+            ),
+            Err(status) if status.is_write_stall() => Err(status).wrap_err(
+                "writes are stalled until compactions catch up and the transaction has been aborted, it can be retried later",
+            ),
+            Err(status) => Err(status.into()),
+        }
     }
 
     fn range_scan_tuple<'a>(
         &'a self,
         lower: &[u8],
         upper: &[u8],
-    ) -> Box<dyn Iterator<Item = Result<Tuple>>>
+    ) -> Box<dyn Iterator<Item = Result<Tuple>> + 'a>
     where
         's: 'a,
     {
-        let mut inner = self.db_tx.iterator().upper_bound(upper).start();
-        inner.seek(lower);
-        Box::new(RocksDbIterator {
-            inner,
-            started: false,
-            upper_bound: upper.to_vec(),
-        })
+        if !self.relation_cfs {
+            return Box::new(self.scan_tuple_part(lower, upper));
+        }
+        Box::new(
+            self.split_by_relation_cf(lower, upper)
+                .into_iter()
+                .flat_map(move |(l, u, _)| self.scan_tuple_part(&l, &u)),
+        )
     }
 
     fn range_skip_scan_tuple<'a>(
@@ -231,45 +1144,34 @@ impl<'s> StoreTx<'s> for RocksDbTx {
         upper: &[u8],
         valid_at: ValidityTs,
     ) -> Box<dyn Iterator<Item = Result<Tuple>> + 'a> {
-        let inner = self.db_tx.iterator().upper_bound(upper).start();
-        Box::new(RocksDbSkipIterator {
-            inner,
-            upper_bound: upper.to_vec(),
-            next_bound: lower.to_owned(),
-            valid_at,
-        })
+        Box::new(RocksDbSkipIterator::new(self.iter(lower, upper), valid_at))
     }
 
     fn range_scan<'a>(
         &'a self,
         lower: &[u8],
         upper: &[u8],
-    ) -> Box<dyn Iterator<Item = Result<(Vec<u8>, Vec<u8>)>>>
+    ) -> Box<dyn Iterator<Item = Result<(Vec<u8>, Vec<u8>)>> + 'a>
     where
         's: 'a,
     {
-        let mut inner = self.db_tx.iterator().upper_bound(upper).start();
-        inner.seek(lower);
-        Box::new(RocksDbIteratorRaw {
-            inner,
-            started: false,
-            upper_bound: upper.to_vec(),
-        })
+        if !self.relation_cfs {
+            return Box::new(self.scan_raw_part(lower, upper));
+        }
+        Box::new(
+            self.split_by_relation_cf(lower, upper)
+                .into_iter()
+                .flat_map(move |(l, u, _)| self.scan_raw_part(&l, &u)),
+        )
     }
 
     fn range_count<'a>(&'a self, lower: &[u8], upper: &[u8]) -> Result<usize>
     where
         's: 'a,
     {
-        let mut inner = self.db_tx.iterator().upper_bound(upper).start();
-        inner.seek(lower);
         let mut count = 0;
-        while let Some(k) = inner.key()? {
-            if k >= upper {
-                break;
-            }
-            count += 1;
-            inner.next();
+        for (part_lower, part_upper, _) in self.split_by_relation_cf(lower, upper) {
+            count += self.iter(&part_lower, &part_upper).count()?;
         }
         Ok(count)
     }
@@ -280,76 +1182,158 @@ impl<'s> StoreTx<'s> for RocksDbTx {
     {
         self.range_scan(&[], &[u8::MAX])
     }
+
+    fn split_range(&self, lower: &[u8], upper: &[u8], n: usize) -> Vec<(Vec<u8>, Vec<u8>)> {
+        self.db.split_range(lower, upper, n)
+    }
 }
 
-pub(crate) struct RocksDbIterator {
-    inner: DbIter,
-    started: bool,
-    upper_bound: Vec<u8>,
+/// Scans move entries over from RocksDB in batches. Batches start small so that scans stopping
+/// early do not read far ahead, and grow up to `SCAN_BATCH_MAX` entries.
+const SCAN_BATCH_MIN: usize = 16;
+const SCAN_BATCH_MAX: usize = 1024;
+const SCAN_BATCH_BYTES: usize = 1 << 20;
+
+/// Gives the iterator back to its transaction for reuse when dropped, except with
+/// `large_transactions`.
+struct PooledIter<'a> {
+    tx: &'a RocksDbTx,
+    inner: Option<DbIter>,
 }
 
-impl RocksDbIterator {
-    #[inline]
-    fn next_inner(&mut self) -> Result<Option<Tuple>> {
-        if self.started {
-            self.inner.next()
-        } else {
-            self.started = true;
+impl Deref for PooledIter<'_> {
+    type Target = DbIter;
+    fn deref(&self) -> &Self::Target {
+        self.inner.as_ref().unwrap()
+    }
+}
+
+impl DerefMut for PooledIter<'_> {
+    fn deref_mut(&mut self) -> &mut Self::Target {
+        self.inner.as_mut().unwrap()
+    }
+}
+
+impl Drop for PooledIter<'_> {
+    fn drop(&mut self) {
+        if let Some(inner) = self.inner.take() {
+            if self.tx.large_transactions {
+                return;
+            }
+            let mut idle = self.tx.idle_iters.lock().unwrap();
+            if idle.len() < MAX_IDLE_ITERS {
+                idle.push(inner);
+            }
         }
-        Ok(match self.inner.pair()? {
-            None => None,
-            Some((k_slice, v_slice)) => {
-                if self.upper_bound.as_slice() <= k_slice {
-                    None
-                } else {
-                    // upper bound is exclusive
-                    Some(decode_tuple_from_kv(k_slice, v_slice, None))
-                }
+    }
+}
+
+pub(crate) struct RocksDbIterator<'a, T> {
+    inner: PooledIter<'a>,
+    buffer: VecDeque<T>,
+    batch_size: usize,
+    exhausted: bool,
+    long_scan: bool,
+    decode: fn(&[u8], &[u8]) -> T,
+}
+
+impl<'a, T> RocksDbIterator<'a, T> {
+    fn new(inner: PooledIter<'a>, decode: fn(&[u8], &[u8]) -> T) -> Self {
+        Self {
+            inner,
+            buffer: VecDeque::new(),
+            batch_size: SCAN_BATCH_MIN,
+            exhausted: false,
+            long_scan: false,
+            decode,
+        }
+    }
+
+    #[inline]
+    fn next_inner(&mut self) -> Result<Option<T>> {
+        if self.buffer.is_empty() && !self.exhausted {
+            if self.batch_size == SCAN_BATCH_MAX && !self.long_scan {
+                // the scan has gone on long enough that reading ahead pays off
+                self.long_scan = true;
+                let tx = self.inner.tx;
+                self.inner
+                    .use_long_scan_reads(tx.scan_async_io, tx.scan_readahead_size);
             }
-        })
+            let batch = self.inner.next_batch(self.batch_size, SCAN_BATCH_BYTES)?;
+            if batch.is_empty() {
+                self.exhausted = true;
+            }
+            let decode = self.decode;
+            self.buffer.extend(batch.map(|(k, v)| decode(k, v)));
+            self.batch_size = (self.batch_size * 2).min(SCAN_BATCH_MAX);
+        }
+        Ok(self.buffer.pop_front())
     }
 }
 
-impl Iterator for RocksDbIterator {
-    type Item = Result<Tuple>;
+impl<T> Iterator for RocksDbIterator<'_, T> {
+    type Item = Result<T>;
     #[inline]
     fn next(&mut self) -> Option<Self::Item> {
         swap_option_result(self.next_inner())
     }
 }
 
-pub(crate) struct RocksDbSkipIterator {
-    inner: DbIter,
-    upper_bound: Vec<u8>,
-    next_bound: Vec<u8>,
-    valid_at: ValidityTs,
+/// Skip scan over a time-travelling relation, returning for each key the version valid at
+/// `valid_at`, if it is an assertion. The seeking is all done on the C++ side in batches.
+pub(crate) struct RocksDbSkipIterator<'a> {
+    inner: PooledIter<'a>,
+    buffer: VecDeque<Tuple>,
+    batch_size: usize,
+    exhausted: bool,
+    seek_suffix: Vec<u8>,
+    skip_suffix: Vec<u8>,
 }
 
-impl RocksDbSkipIterator {
+impl<'a> RocksDbSkipIterator<'a> {
+    fn new(inner: PooledIter<'a>, valid_at: ValidityTs) -> Self {
+        Self {
+            inner,
+            buffer: VecDeque::new(),
+            batch_size: SCAN_BATCH_MIN,
+            exhausted: false,
+            // the first version at or before `valid_at`
+            seek_suffix: encode_validity(Validity {
+                timestamp: valid_at,
+                is_assert: Reverse(true),
+            }),
+            // sorts after every version of the key
+            skip_suffix: encode_validity(TERMINAL_VALIDITY),
+        }
+    }
+
     #[inline]
     fn next_inner(&mut self) -> Result<Option<Tuple>> {
-        loop {
-            self.inner.seek(&self.next_bound);
-            match self.inner.pair()? {
-                None => return Ok(None),
-                Some((k_slice, v_slice)) => {
-                    if self.upper_bound.as_slice() <= k_slice {
-                        return Ok(None);
-                    }
-
-                    let (ret, nxt_bound) = check_key_for_validity(k_slice, self.valid_at, None);
-                    self.next_bound = nxt_bound;
-                    if let Some(mut tup) = ret {
-                        extend_tuple_from_v(&mut tup, v_slice);
-                        return Ok(Some(tup));
-                    }
-                }
+        if self.buffer.is_empty() && !self.exhausted {
+            let batch = self.inner.skip_scan_batch(
+                self.batch_size,
+                SCAN_BATCH_BYTES,
+                &self.seek_suffix,
+                &self.skip_suffix,
+            )?;
+            if batch.is_empty() {
+                self.exhausted = true;
             }
+            self.buffer
+                .extend(batch.map(|(k, v)| decode_tuple_from_kv(k, v, None)));
+            self.batch_size = (self.batch_size * 2).min(SCAN_BATCH_MAX);
         }
+        Ok(self.buffer.pop_front())
     }
 }
 
-impl Iterator for RocksDbSkipIterator {
+fn encode_validity(vld: Validity) -> Vec<u8> {
+    let mut ret = vec![];
+    ret.encode_datavalue(&DataValue::Validity(vld));
+    ret
+}
+
+impl Iterator for RocksDbSkipIterator<'_> {
     type Item = Result<Tuple>;
     #[inline]
     fn next(&mut self) -> Option<Self::Item> {
@@ -357,38 +1341,632 @@ impl Iterator for RocksDbSkipIterator {
     }
 }
 
-pub(crate) struct RocksDbIteratorRaw {
-    inner: DbIter,
-    started: bool,
-    upper_bound: Vec<u8>,
-}
+#[cfg(test)]
+mod tests {
+    use serde_json::json;
 
-impl RocksDbIteratorRaw {
-    #[inline]
-    fn next_inner(&mut self) -> Result<Option<(Vec<u8>, Vec<u8>)>> {
-        if self.started {
-            self.inner.next()
-        } else {
-            self.started = true;
-        }
-        Ok(match self.inner.pair()? {
-            None => None,
-            Some((k_slice, v_slice)) => {
-                if self.upper_bound.as_slice() <= k_slice {
-                    // upper bound is exclusive
-                    None
-                } else {
-                    Some((k_slice.to_vec(), v_slice.to_vec()))
+    use super::*;
+    use crate::data::tuple::TupleT;
+    use crate::{NamedRows, RelationChange, ScriptMutability};
+
+    /// A directory of its own for the database of each test, removed when dropped
+    struct TestDir(PathBuf);
+
+    impl TestDir {
+        fn new(name: &str) -> Self {
+            let path = std::env::temp_dir().join(format!(
+                "cozo-rocksdb-test-{}-{}",
+                name,
+                std::process::id()
+            ));
+            let _ = fs::remove_dir_all(&path);
+            Self(path)
+        }
+    }
+
+    impl Drop for TestDir {
+        fn drop(&mut self) {
+            let _ = fs::remove_dir_all(&self.0);
+        }
+    }
+
+    fn run(db: &Db<RocksDbStorage>, script: &str) -> NamedRows {
+        db.run_script(script, Default::default(), ScriptMutability::Mutable)
+            .unwrap()
+    }
+
+    fn relation_id(db: &Db<RocksDbStorage>, name: &str) -> u64 {
+        let tx = db.transact().unwrap();
+        tx.get_relation(name, false).unwrap().id.0
+    }
+
+    /// Bounds of the keys of the relation
+    fn relation_range(db: &Db<RocksDbStorage>, name: &str) -> (Vec<u8>, Vec<u8>) {
+        let tx = db.transact().unwrap();
+        let handle = tx.get_relation(name, false).unwrap();
+        (
+            Tuple::default().encode_as_key(handle.id),
+            Tuple::default().encode_as_key(handle.id.next()),
+        )
+    }
+
+    fn relation_cfs(db: &Db<RocksDbStorage>) -> Vec<u64> {
+        let tx = db.db.transact(false).unwrap();
+        tx.db_tx.relation_cfs_in_range(&[], &[u8::MAX])
+    }
+
+    /// The relation id followed by `i`, without going through the tuple encoding
+    fn raw_key(rel_id: u64, i: u64) -> Vec<u8> {
+        let mut key = rel_id.to_be_bytes().to_vec();
+        key.extend(i.to_be_bytes());
+        key
+    }
+
+    #[test]
+    fn test_relation_cfs_reopen_and_destroy() {
+        let dir = TestDir::new("relation-cfs");
+        let opts = RocksDbOptions {
+            column_family_per_relation: true,
+            ..Default::default()
+        };
+        let (a, b) = {
+            let db = new_cozo_rocksdb_with_options(&dir.0, opts.clone()).unwrap();
+            run(&db, ":create a {k: Int => v: String}");
+            run(&db, ":create b {k: Int}");
+            run(&db, "?[k, v] <- [[1, 'x'], [2, 'y']] :put a {k => v}");
+            run(&db, "?[k] <- [[3]] :put b {k}");
+            let (a, b) = (relation_id(&db, "a"), relation_id(&db, "b"));
+            assert_eq!(relation_cfs(&db), vec![a, b]);
+            (a, b)
+        };
+
+        // the column families are found again, the option only matters for new databases
+        let db = new_cozo_rocksdb_with_options(&dir.0, RocksDbOptions::default()).unwrap();
+        assert!(db.db.db.uses_relation_cfs());
+        assert_eq!(relation_cfs(&db), vec![a, b]);
+        let rows = run(&db, "?[k, v] := *a[k, v]").into_json();
+        assert_eq!(rows["rows"], json!([[1, "x"], [2, "y"]]));
+
+        run(&db, "::remove a");
+        assert_eq!(relation_cfs(&db), vec![b]);
+        drop(db);
+
+        let db = new_cozo_rocksdb_with_options(&dir.0, opts).unwrap();
+        assert_eq!(relation_cfs(&db), vec![b]);
+        let rows = run(&db, "?[k] := *b[k]").into_json();
+        assert_eq!(rows["rows"], json!([[3]]));
+        assert!(db
+            .run_script(
+                "?[k] := *a[k, _]",
+                Default::default(),
+                ScriptMutability::Mutable
+            )
+            .is_err());
+    }
+
+    #[test]
+    fn test_next_batch_bounds() {
+        let dir = TestDir::new("next-batch");
+        let db = new_cozo_rocksdb_with_options(&dir.0, RocksDbOptions::default()).unwrap();
+        // a key of 16 bytes and a value of `val_len` bytes take 24 + `val_len` bytes in a batch
+        let cases = [
+            // 1 KiB each: a full batch reaches both bounds at once
+            (1000, 1025, vec![1024, 1]),
+            // one byte more: only 1023 of them stay within 1 MiB
+            (1001, 1025, vec![1023, 2]),
+            (1, 2049, vec![1024, 1024, 1]),
+            // entries larger than the bound still come one at a time
+            (SCAN_BATCH_BYTES, 3, vec![1, 1, 1]),
+        ];
+        for (i, (val_len, n, expected)) in cases.into_iter().enumerate() {
+            let rel_id = 1000 + i as u64;
+            let mut tx = db.db.transact(true).unwrap();
+            for j in 0..n {
+                tx.put(&raw_key(rel_id, j), &vec![j as u8; val_len])
+                    .unwrap();
+            }
+            tx.commit().unwrap();
+
+            let lower = rel_id.to_be_bytes();
+            let upper = (rel_id + 1).to_be_bytes();
+            let tx = db.db.transact(false).unwrap();
+            let mut iter = tx.iter(&lower, &upper);
+            let mut sizes = vec![];
+            let mut next = 0;
+            loop {
+                let batch = iter.next_batch(SCAN_BATCH_MAX, SCAN_BATCH_BYTES).unwrap();
+                if batch.is_empty() {
+                    break;
                 }
+                let mut size = 0;
+                for (key, val) in batch {
+                    assert_eq!(key, raw_key(rel_id, next));
+                    assert_eq!(val, vec![next as u8; val_len]);
+                    next += 1;
+                    size += 1;
+                }
+                sizes.push(size);
             }
-        })
+            assert_eq!(sizes, expected, "values of {val_len} bytes");
+            drop(iter);
+            assert_eq!(tx.range_scan(&lower, &upper).count(), n as usize);
+        }
     }
-}
 
-impl Iterator for RocksDbIteratorRaw {
-    type Item = Result<(Vec<u8>, Vec<u8>)>;
-    #[inline]
-    fn next(&mut self) -> Option<Self::Item> {
-        swap_option_result(self.next_inner())
+    #[test]
+    fn test_skip_scan_matches_mem_skip_iterator() {
+        let dir = TestDir::new("skip-scan");
+        let db = new_cozo_rocksdb_with_options(&dir.0, RocksDbOptions::default()).unwrap();
+        run(&db, ":create tt {k: Int, vld: Validity => v: Int}");
+        // keys with up to five versions each, a third of them retractions
+        let mut rows = vec![];
+        for k in 0..300 {
+            for j in 0..(k % 5 + 1) {
+                let is_assert = (k + j) % 3 != 0;
+                rows.push(format!("[{k}, [{}, {is_assert}], {}]", 10 * j, 100 * k + j));
+            }
+        }
+        run(
+            &db,
+            &format!(
+                "?[k, vld, v] <- [{}] :put tt {{k, vld => v}}",
+                rows.join(", ")
+            ),
+        );
+
+        let (lower, upper) = relation_range(&db, "tt");
+        let tx = db.db.transact(false).unwrap();
+        let stored = tx
+            .range_scan(&lower, &upper)
+            .collect::<Result<BTreeMap<_, _>>>()
+            .unwrap();
+        for ts in [-1, 0, 5, 10, 15, 20, 35, 40, 1000] {
+            let valid_at = ValidityTs(Reverse(ts));
+            let expected = crate::storage::mem::SkipIterator {
+                inner: &stored,
+                upper: upper.clone(),
+                valid_at,
+                next_bound: lower.clone(),
+                size_hint: None,
+            }
+            .collect_vec();
+            let found = tx
+                .range_skip_scan_tuple(&lower, &upper, valid_at)
+                .collect::<Result<Vec<_>>>()
+                .unwrap();
+            assert_eq!(found.is_empty(), ts < 0);
+            assert_eq!(found, expected, "valid at {ts}");
+        }
+    }
+
+    #[test]
+    fn test_key_columns_prefix_matches_memcmp_encoding() {
+        use crate::data::value::{JsonData, RegexWrapper, UuidWrapper, Vector};
+        use crate::runtime::relation::RelationId;
+
+        let values = vec![
+            DataValue::Null,
+            DataValue::from(false),
+            DataValue::from(true),
+            DataValue::from(0),
+            DataValue::from(-7),
+            // not exactly a float, encoded with the integer after it
+            DataValue::from(i64::MAX),
+            DataValue::from(1.5),
+            DataValue::from(""),
+            DataValue::from("abcdefgh"),
+            DataValue::from("a string taking several groups of bytes"),
+            DataValue::Bytes(vec![0xff; 20]),
+            DataValue::Uuid(UuidWrapper(uuid::Uuid::from_u128(42))),
+            DataValue::Regex(RegexWrapper(regex::Regex::new("a+b").unwrap())),
+            DataValue::List(vec![
+                DataValue::from(1),
+                DataValue::from("x"),
+                DataValue::List(vec![]),
+            ]),
+            DataValue::Set([DataValue::from(1), DataValue::from(2)].into()),
+            DataValue::Vec(Vector::F32(ndarray::Array1::from(vec![1.0, 2.0]))),
+            DataValue::Vec(Vector::F64(ndarray::Array1::from(vec![1.0, 2.0, 3.0]))),
+            DataValue::Json(JsonData(json!({"a": [1, 2]}))),
+            DataValue::Validity(Validity {
+                timestamp: ValidityTs(Reverse(10)),
+                is_assert: Reverse(true),
+            }),
+            DataValue::Bot,
+        ];
+        let rel_id = RelationId::new(7);
+        for val in values {
+            let key = vec![val.clone(), DataValue::from(1), val.clone()];
+            let encoded = key.encode_as_key(rel_id);
+            for n in 0..=key.len() {
+                assert_eq!(
+                    cozorocks::key_columns_prefix_len(&encoded, n),
+                    key[..n].encode_as_key(rel_id).len(),
+                    "{n} columns of {val:?}"
+                );
+            }
+            // keys with fewer columns are outside of the domain
+            assert_eq!(cozorocks::key_columns_prefix_len(&encoded, 4), 0);
+            assert_eq!(cozorocks::key_columns_prefix_len(&encoded[..8], 1), 0);
+        }
+    }
+
+    #[test]
+    fn test_validity_retention_after_compaction() {
+        let dir = TestDir::new("validity-retention");
+        let db = new_cozo_rocksdb_with_options(&dir.0, RocksDbOptions::default()).unwrap();
+        let now = crate::data::functions::current_validity().0 .0;
+        let minute = 60_000_000;
+        let hour = 60 * minute;
+        for (name, expire_current) in [("kept", false), ("expired", true)] {
+            run(
+                &db,
+                &format!(":create {name} {{k: Int, vld: Validity => v: Int}}"),
+            );
+            let versions = [
+                (1, now - 3 * hour, 10),
+                (1, now - 2 * hour, 11),
+                (1, now - minute, 12),
+                (2, now - 3 * hour, 20),
+                (2, now - 2 * hour, 21),
+            ];
+            let rows = versions
+                .iter()
+                .map(|(k, ts, v)| format!("[{k}, [{ts}, true], {v}]"))
+                .join(", ");
+            run(
+                &db,
+                &format!("?[k, vld, v] <- [{rows}] :put {name} {{k, vld => v}}"),
+            );
+            db.set_validity_retention(name, Some(Duration::from_secs(3600)), expire_current)
+                .unwrap();
+            let (lower, upper) = relation_range(&db, name);
+            db.db.range_compact(&lower, &upper).unwrap();
+
+            let tx = db.db.transact(false).unwrap();
+            let left = tx
+                .range_scan_tuple(&lower, &upper)
+                .map(|tuple| {
+                    let tuple = tuple.unwrap();
+                    (tuple[0].get_int().unwrap(), tuple[2].get_int().unwrap())
+                })
+                .collect_vec();
+            drop(tx);
+            let current = run(&db, &format!("?[k, v] := *{name}{{k, v @ 'NOW'}}")).into_json();
+            if expire_current {
+                // rows not written within the retention disappear
+                assert_eq!(left, vec![(1, 12)]);
+                assert_eq!(current["rows"], json!([[1, 12]]));
+            } else {
+                // the versions current at the horizon are kept
+                assert_eq!(left, vec![(1, 12), (1, 11), (2, 21)]);
+                assert_eq!(current["rows"], json!([[1, 12], [2, 21]]));
+            }
+        }
+    }
+
+    /// Non-key columns in the format of values of stored relations
+    fn encode_val(rel_id: u64, cols: &[DataValue]) -> Vec<u8> {
+        use serde::Serialize;
+
+        let mut ret = rel_id.to_be_bytes().to_vec();
+        cols.serialize(&mut rmp_serde::Serializer::new(&mut ret))
+            .unwrap();
+        ret
+    }
+
+    #[test]
+    fn test_merge_operator() {
+        use cozorocks::{merge_operand, MergeOp};
+
+        let dir = TestDir::new("merge-operator");
+        let db = new_cozo_rocksdb_with_options(&dir.0, RocksDbOptions::default()).unwrap();
+        let int = |i: i64| DataValue::from(i);
+        let float = |f: f64| DataValue::from(f);
+        let list = DataValue::List;
+        let cases = vec![
+            // sums take the smallest integer encoding, as puts do
+            (vec![int(100)], MergeOp::Sum, vec![int(28)], vec![int(128)]),
+            (
+                vec![int(-100)],
+                MergeOp::Sum,
+                vec![int(-50)],
+                vec![int(-150)],
+            ),
+            (
+                vec![int(70000)],
+                MergeOp::Sum,
+                vec![int(-70000)],
+                vec![int(0)],
+            ),
+            (
+                vec![int(i64::MAX)],
+                MergeOp::Sum,
+                vec![int(1)],
+                vec![int(i64::MIN)],
+            ),
+            (
+                vec![float(1.5)],
+                MergeOp::Sum,
+                vec![float(2.25)],
+                vec![float(3.75)],
+            ),
+            (
+                vec![int(1)],
+                MergeOp::Sum,
+                vec![float(0.5)],
+                vec![float(1.5)],
+            ),
+            (
+                vec![float(0.5)],
+                MergeOp::Sum,
+                vec![int(2)],
+                vec![float(2.5)],
+            ),
+            (vec![int(3)], MergeOp::Min, vec![int(1)], vec![int(1)]),
+            (vec![int(3)], MergeOp::Max, vec![int(1)], vec![int(3)]),
+            (
+                vec![int(1)],
+                MergeOp::Min,
+                vec![float(0.5)],
+                vec![float(0.5)],
+            ),
+            (
+                vec![int(2)],
+                MergeOp::Max,
+                vec![float(2.5)],
+                vec![float(2.5)],
+            ),
+            (
+                vec![float(2.5)],
+                MergeOp::Max,
+                vec![int(2)],
+                vec![float(2.5)],
+            ),
+            (
+                vec![list(vec![int(1), int(2)])],
+                MergeOp::Union,
+                vec![list(vec![int(2), float(3.5)])],
+                vec![list(vec![int(1), int(2), float(3.5)])],
+            ),
+            // columns not holding what the op expects are replaced
+            (
+                vec![DataValue::from("a")],
+                MergeOp::Sum,
+                vec![int(1)],
+                vec![int(1)],
+            ),
+            (
+                vec![int(1)],
+                MergeOp::Union,
+                vec![list(vec![])],
+                vec![list(vec![])],
+            ),
+        ];
+        let rel_id = 2000;
+        let mut tx = db.db.transact(true).unwrap();
+        for (i, (cur, op, operand, _)) in cases.iter().enumerate() {
+            let key = raw_key(rel_id, i as u64);
+            tx.put(&key, &encode_val(rel_id, cur)).unwrap();
+            tx.db_tx
+                .merge(&key, &merge_operand(&[*op], &encode_val(rel_id, operand)))
+                .unwrap();
+        }
+        // several columns, each with an op of its own, on a key without a value before them
+        let key = raw_key(rel_id, cases.len() as u64);
+        let ops = [
+            MergeOp::Sum,
+            MergeOp::Keep,
+            MergeOp::Replace,
+            MergeOp::Union,
+        ];
+        let first = vec![int(1), int(2), int(3), list(vec![int(1)])];
+        let second = vec![int(10), int(20), int(30), list(vec![int(2)])];
+        for operand in [&first, &second] {
+            tx.db_tx
+                .merge(&key, &merge_operand(&ops, &encode_val(rel_id, operand)))
+                .unwrap();
+        }
+        tx.commit().unwrap();
+        let mut expected = cases
+            .into_iter()
+            .map(|(_, _, _, merged)| merged)
+            .collect_vec();
+        expected.push(vec![int(11), int(2), int(30), list(vec![int(1), int(2)])]);
+
+        let check = |when: &str| {
+            let tx = db.db.transact(false).unwrap();
+            for (i, merged) in expected.iter().enumerate() {
+                let found = tx.get(&raw_key(rel_id, i as u64), false).unwrap().unwrap();
+                assert_eq!(found, encode_val(rel_id, merged), "case {i} {when}");
+                let mut decoded = vec![];
+                crate::runtime::relation::extend_tuple_from_v(&mut decoded, &found);
+                assert_eq!(&decoded, merged, "case {i} {when}");
+            }
+        };
+        check("when read");
+        db.db
+            .range_compact(&rel_id.to_be_bytes(), &(rel_id + 1).to_be_bytes())
+            .unwrap();
+        check("after compaction");
+    }
+
+    #[test]
+    fn test_changes_since() {
+        let dir = TestDir::new("changes-since");
+        let db = new_cozo_rocksdb_with_options(&dir.0, RocksDbOptions::default()).unwrap();
+        run(&db, ":create a {k: Int => v: String}");
+        run(&db, ":create b {k: Int}");
+        run(&db, "?[k, v] <- [[0, 'w']] :put a {k => v}");
+        let since = db.changes_since("a", 0, 0).unwrap().next;
+
+        run(&db, "?[k, v] <- [[1, 'x']] :put a {k => v}");
+        // writes to other relations take sequence numbers but are not returned
+        run(&db, "?[k] <- [[1]] :put b {k}");
+        run(&db, "?[k, v] <- [[2, 'y']] :put a {k => v}");
+        run(&db, "?[k] <- [[1]] :rm a {k}");
+        let (lower, upper) = relation_range(&db, "a");
+        let mut tx = db.db.transact(true).unwrap();
+        tx.db_tx.del_range_on_commit(&lower, &upper);
+        tx.commit().unwrap();
+
+        let changes = db.changes_since("a", since, 100).unwrap();
+        let next = changes.next;
+        assert_eq!(next, db.changes_since("a", 0, 0).unwrap().next);
+        let seqs = changes
+            .changes
+            .iter()
+            .map(|change| match change {
+                RelationChange::Put { seq, .. }
+                | RelationChange::Delete { seq, .. }
+                | RelationChange::Clear { seq } => *seq,
+            })
+            .collect_vec();
+        assert!(seqs[0] >= since);
+        assert!(seqs.windows(2).all(|w| w[0] < w[1]), "{seqs:?}");
+        let mut changes = changes.into_json();
+        for change in changes["changes"].as_array_mut().unwrap() {
+            change.as_object_mut().unwrap().remove("seq");
+        }
+        assert_eq!(
+            changes["changes"],
+            json!([
+                {"op": "put", "row": [1, "x"]},
+                {"op": "put", "row": [2, "y"]},
+                {"op": "delete", "row": [1]},
+                {"op": "clear"},
+            ])
+        );
+
+        // a page ends before the write it is full at, and the next one starts from it
+        let mut from = since;
+        let mut paged = vec![];
+        loop {
+            let page = db.changes_since("a", from, 1).unwrap();
+            assert!(page.changes.len() <= 1);
+            if page.changes.is_empty() {
+                assert_eq!(page.next, next);
+                break;
+            }
+            from = page.next;
+            paged.extend(page.changes);
+        }
+        assert_eq!(paged.len(), seqs.len());
+        assert!(db.changes_since("a", next, 100).unwrap().changes.is_empty());
+    }
+
+    #[test]
+    fn test_par_put_from_threads() {
+        const N_THREADS: u64 = 4;
+        const N_KEYS: u64 = 500;
+
+        for optimistic in [false, true] {
+            let dir = TestDir::new(&format!("par-put-{optimistic}"));
+            let opts = RocksDbOptions {
+                optimistic,
+                ..Default::default()
+            };
+            let db = new_cozo_rocksdb_with_options(&dir.0, opts).unwrap();
+            let rel_id = 3000;
+            let (lower, upper) = (rel_id.to_be_bytes(), (rel_id + 1).to_be_bytes());
+            let key = |t: u64, i: u64| raw_key(rel_id, t * N_KEYS + i);
+            let removed = key(N_THREADS, 0);
+            let mut tx = db.db.transact(true).unwrap();
+            tx.put(&removed, b"removed").unwrap();
+            tx.commit().unwrap();
+
+            let mut tx = db.db.transact(true).unwrap();
+            assert!(tx.supports_par_put());
+            std::thread::scope(|s| {
+                let tx = &tx;
+                for t in 0..N_THREADS {
+                    s.spawn(move || {
+                        for i in 0..N_KEYS {
+                            tx.par_put(&key(t, i), &t.to_be_bytes()).unwrap();
+                        }
+                    });
+                }
+                s.spawn(|| tx.par_del(&removed).unwrap());
+            });
+            // not part of the transaction before the flush
+            assert_eq!(tx.range_count(&lower, &upper).unwrap(), 1);
+            assert!(tx.get(&key(0, 0), false).unwrap().is_none());
+
+            tx.par_flush().unwrap();
+            assert_eq!(
+                tx.range_count(&lower, &upper).unwrap(),
+                (N_THREADS * N_KEYS) as usize
+            );
+            assert!(!tx.exists(&removed, false).unwrap());
+            for t in 0..N_THREADS {
+                assert_eq!(
+                    tx.get(&key(t, N_KEYS - 1), false).unwrap(),
+                    Some(t.to_be_bytes().to_vec())
+                );
+            }
+            // nothing is left to apply twice on commit
+            tx.commit().unwrap();
+
+            let tx = db.db.transact(false).unwrap();
+            let found = tx
+                .range_scan(&lower, &upper)
+                .map(|kv| kv.unwrap())
+                .collect_vec();
+            assert_eq!(found.len(), (N_THREADS * N_KEYS) as usize);
+            for (j, (k, v)) in found.into_iter().enumerate() {
+                let (t, i) = (j as u64 / N_KEYS, j as u64 % N_KEYS);
+                assert_eq!(k, key(t, i), "optimistic: {optimistic}");
+                assert_eq!(v, t.to_be_bytes(), "optimistic: {optimistic}");
+            }
+        }
+    }
+
+    #[test]
+    fn test_large_transactions_write_out_after_scans() {
+        const N_KEYS: u64 = 20000;
+
+        let dir = TestDir::new("large-transactions");
+        let opts = RocksDbOptions {
+            large_transactions: true,
+            transaction_memory_limit: 1 << 20,
+            ..Default::default()
+        };
+        let db = new_cozo_rocksdb_with_options(&dir.0, opts).unwrap();
+        // writes only reach the memtables before the commit if the transaction wrote them out
+        let memtable_entries = || {
+            db.db
+                .db
+                .stats()
+                .into_iter()
+                .filter(|(name, _)| {
+                    name == "rocksdb.num-entries-active-mem-table"
+                        || name == "rocksdb.num-entries-imm-mem-tables"
+                })
+                .map(|(_, value)| value)
+                .sum::<u64>()
+        };
+        let rel_id = 4000;
+        let (lower, upper) = (rel_id.to_be_bytes(), (rel_id + 1).to_be_bytes());
+        let val = [7u8; 256];
+
+        let mut tx = db.db.transact(true).unwrap();
+        assert_eq!(tx.range_scan(&lower, &upper).count(), 0);
+        let before = memtable_entries();
+        for i in 0..N_KEYS {
+            tx.put(&raw_key(rel_id, i), &val).unwrap();
+        }
+        assert!(memtable_entries() - before > N_KEYS / 2);
+        tx.commit().unwrap();
+
+        // rows of relations without column families of their own are deleted one by one
+        let mut tx = db.db.transact(true).unwrap();
+        assert_eq!(tx.range_count(&lower, &upper).unwrap(), N_KEYS as usize);
+        let before = memtable_entries();
+        tx.del_range_from_persisted(&lower, &upper).unwrap();
+        assert!(memtable_entries() - before > N_KEYS / 2);
+        tx.commit().unwrap();
+
+        let tx = db.db.transact(false).unwrap();
+        assert_eq!(tx.range_count(&lower, &upper).unwrap(), 0);
     }
 }
@@ -27,6 +27,9 @@ extern "C" {
  * `path`:    should contain the UTF-8 encoded path name as a null-terminated C-string.
  * `db_id`:   will contain the ID of the database opened.
  * `options`: options for the DB constructor: engine dependent.
+ *            For "rocksdb", a JSON object such as `{"read_only": true}` or
+ *            `{"secondary_path": "...", "catch_up_interval_ms": 1000}` opens a database
+ *            that another process has open for writing, without writing to it.
  *
  * When the function is successful, null pointer is returned,
  * otherwise a pointer to a C-string containing the error message will be returned.
@@ -124,6 +127,85 @@ char *cozo_restore(int32_t db_id,
 char *cozo_import_from_backup(int32_t db_id,
                               const char *json_payload);
 
+/**
+ * Get the counters and gauges of the storage engine, such as block cache hit rates,
+ * memtable sizes, pending compaction bytes, write stalls and file counts per level.
+ * Storage engines without any return no rows.
+ *
+ * `db_id`: the ID representing the database.
+ *
+ * Returns a UTF-8-encoded C-string that **must** be freed with `cozo_free_str`.
+ * The string contains the JSON rows `[stat, value]`, as returned by queries.
+ */
+char *cozo_storage_stats(int32_t db_id);
+
+/**
+ * Write a consistent copy of the database in the native format of its storage engine.
+ * The copy can be opened as a database of the same engine.
+ * For RocksDB, data files are hard-linked when possible, so this only takes seconds.
+ *
+ * `db_id`:   the ID representing the database.
+ * `out_dir`: path of the directory to write the copy into, which must not exist.
+ *
+ * Returns a UTF-8-encoded C-string indicating the result that **must** be freed with `cozo_free_str`.
+ */
+char *cozo_checkpoint(int32_t db_id,
+                      const char *out_dir);
+
+/**
+ * Add an incremental backup of the database to a backup directory, in the native format
+ * of its storage engine. Only the data not in earlier backups in the directory is copied.
+ *
+ * `db_id`:      the ID representing the database.
+ * `backup_dir`: path of the backup directory.
+ *
+ * Returns a UTF-8-encoded C-string indicating the result that **must** be freed with `cozo_free_str`.
+ */
+char *cozo_incremental_backup(int32_t db_id,
+                              const char *backup_dir);
+
+/**
+ * Restore the latest incremental backup in a backup directory as a new database.
+ *
+ * `engine`:     the engine the backup was made with, currently only `rocksdb`.
+ * `backup_dir`: path of the backup directory.
+ * `path`:       path of the database to create, which must not exist.
+ *
+ * Returns a UTF-8-encoded C-string indicating the result that **must** be freed with `cozo_free_str`.
+ */
+char *cozo_restore_incremental_backup(const char *engine,
+                                      const char *backup_dir,
+                                      const char *path);
+
+/**
+ * For a database opened as a secondary instance, make what the primary instance has
+ * written so far visible to queries. For RocksDB, this applies to databases opened with
+ * the `secondary_path` option.
+ *
+ * `db_id`: the ID representing the database.
+ *
+ * Returns a UTF-8-encoded C-string indicating the result that **must** be freed with `cozo_free_str`.
+ */
+char *cozo_catch_up_with_primary(int32_t db_id);
+
+/**
+ * Read back the writes to a stored relation, to follow them without running queries.
+ * Only the RocksDB engine supports this, and only for the writes made within
+ * its `change_feed_retention_secs` option.
+ *
+ * `db_id`:    the ID representing the database.
+ * `relation`: the name of the stored relation.
+ * `since`:    the sequence number to read the writes from, as returned by the previous call.
+ * `limit`:    the maximum number of writes to return. With `0`, no writes are returned,
+ *             only the sequence number following the latest write, to start from.
+ *
+ * Returns a UTF-8-encoded C-string that **must** be freed with `cozo_free_str`. On success,
+ * its `changes` are objects with an `op` of `put`, `delete` or `clear`, a `seq` and the
+ * `row` put or the keys of the row deleted (named by `headers`), and its `next` is the
+ * sequence number to pass as `since` to get the writes that follow.
+ */
+char *cozo_changes_since(int32_t db_id, const char *relation, uint64_t since, uint64_t limit);
+
 /**
  * Free any C-string returned from the Cozo C API.
  * Must be called exactly once for each returned C-string.
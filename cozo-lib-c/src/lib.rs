@@ -36,6 +36,9 @@ lazy_static! {
 /// `path`:    should contain the UTF-8 encoded path name as a null-terminated C-string.
 /// `db_id`:   will contain the ID of the database opened.
 /// `options`: options for the DB constructor: engine dependent.
+///            For "rocksdb", a JSON object such as `{"read_only": true}` or
+///            `{"secondary_path": "...", "catch_up_interval_ms": 1000}` opens a database
+///            that another process has open for writing, without writing to it.
 ///
 /// When the function is successful, null pointer is returned,
 /// otherwise a pointer to a C-string containing the error message will be returned.
@@ -315,6 +318,201 @@ pub unsafe extern "C" fn cozo_import_from_backup(
         .into_raw()
 }
 
+#[no_mangle]
+/// Get the counters and gauges of the storage engine, such as block cache hit rates,
+/// memtable sizes, pending compaction bytes, write stalls and file counts per level.
+/// Storage engines without any return no rows.
+///
+/// `db_id`: the ID representing the database.
+///
+/// Returns a UTF-8-encoded C-string that **must** be freed with `cozo_free_str`.
+/// The string contains the JSON rows `[stat, value]`, as returned by queries.
+pub unsafe extern "C" fn cozo_storage_stats(db_id: i32) -> *mut c_char {
+    let db = {
+        let db_ref = {
+            let dbs = HANDLES.dbs.lock().unwrap();
+            dbs.get(&db_id).cloned()
+        };
+        match db_ref {
+            None => {
+                return CString::new(r##"{"ok":false,"message":"database closed"}"##)
+                    .unwrap()
+                    .into_raw();
+            }
+            Some(db) => db,
+        }
+    };
+    CString::new(db.storage_stats_str()).unwrap().into_raw()
+}
+
+#[no_mangle]
+/// Write a consistent copy of the database in the native format of its storage engine.
+/// The copy can be opened as a database of the same engine.
+/// For RocksDB, data files are hard-linked when possible, so this only takes seconds.
+///
+/// `db_id`:   the ID representing the database.
+/// `out_dir`: path of the directory to write the copy into, which must not exist.
+///
+/// Returns a UTF-8-encoded C-string indicating the result that **must** be freed with `cozo_free_str`.
+pub unsafe extern "C" fn cozo_checkpoint(db_id: i32, out_dir: *const c_char) -> *mut c_char {
+    let db = {
+        let db_ref = {
+            let dbs = HANDLES.dbs.lock().unwrap();
+            dbs.get(&db_id).cloned()
+        };
+        match db_ref {
+            None => {
+                return CString::new(r##"{"ok":false,"message":"database closed"}"##)
+                    .unwrap()
+                    .into_raw();
+            }
+            Some(db) => db,
+        }
+    };
+    let out_dir = match CStr::from_ptr(out_dir).to_str() {
+        Ok(p) => p,
+        Err(err) => return CString::new(format!("{err}")).unwrap().into_raw(),
+    };
+    CString::new(db.checkpoint_str(out_dir)).unwrap().into_raw()
+}
+
+#[no_mangle]
+/// Add an incremental backup of the database to a backup directory, in the native format
+/// of its storage engine. Only the data not in earlier backups in the directory is copied.
+///
+/// `db_id`:      the ID representing the database.
+/// `backup_dir`: path of the backup directory.
+///
+/// Returns a UTF-8-encoded C-string indicating the result that **must** be freed with `cozo_free_str`.
+pub unsafe extern "C" fn cozo_incremental_backup(
+    db_id: i32,
+    backup_dir: *const c_char,
+) -> *mut c_char {
+    let db = {
+        let db_ref = {
+            let dbs = HANDLES.dbs.lock().unwrap();
+            dbs.get(&db_id).cloned()
+        };
+        match db_ref {
+            None => {
+                return CString::new(r##"{"ok":false,"message":"database closed"}"##)
+                    .unwrap()
+                    .into_raw();
+            }
+            Some(db) => db,
+        }
+    };
+    let backup_dir = match CStr::from_ptr(backup_dir).to_str() {
+        Ok(p) => p,
+        Err(err) => return CString::new(format!("{err}")).unwrap().into_raw(),
+    };
+    CString::new(db.incremental_backup_str(backup_dir))
+        .unwrap()
+        .into_raw()
+}
+
+#[no_mangle]
+/// Restore the latest incremental backup in a backup directory as a new database.
+///
+/// `engine`:     the engine the backup was made with, currently only `rocksdb`.
+/// `backup_dir`: path of the backup directory.
+/// `path`:       path of the database to create, which must not exist.
+///
+/// Returns a UTF-8-encoded C-string indicating the result that **must** be freed with `cozo_free_str`.
+pub unsafe extern "C" fn cozo_restore_incremental_backup(
+    engine: *const c_char,
+    backup_dir: *const c_char,
+    path: *const c_char,
+) -> *mut c_char {
+    let engine = match CStr::from_ptr(engine).to_str() {
+        Ok(p) => p,
+        Err(err) => return CString::new(format!("{err}")).unwrap().into_raw(),
+    };
+    let backup_dir = match CStr::from_ptr(backup_dir).to_str() {
+        Ok(p) => p,
+        Err(err) => return CString::new(format!("{err}")).unwrap().into_raw(),
+    };
+    let path = match CStr::from_ptr(path).to_str() {
+        Ok(p) => p,
+        Err(err) => return CString::new(format!("{err}")).unwrap().into_raw(),
+    };
+    CString::new(restore_incremental_backup_str(engine, backup_dir, path))
+        .unwrap()
+        .into_raw()
+}
+
+#[no_mangle]
+/// For a database opened as a secondary instance, make what the primary instance has
+/// written so far visible to queries. For RocksDB, this applies to databases opened with
+/// the `secondary_path` option.
+///
+/// `db_id`: the ID representing the database.
+///
+/// Returns a UTF-8-encoded C-string indicating the result that **must** be freed with `cozo_free_str`.
+pub unsafe extern "C" fn cozo_catch_up_with_primary(db_id: i32) -> *mut c_char {
+    let db = {
+        let db_ref = {
+            let dbs = HANDLES.dbs.lock().unwrap();
+            dbs.get(&db_id).cloned()
+        };
+        match db_ref {
+            None => {
+                return CString::new(r##"{"ok":false,"message":"database closed"}"##)
+                    .unwrap()
+                    .into_raw();
+            }
+            Some(db) => db,
+        }
+    };
+    CString::new(db.catch_up_with_primary_str())
+        .unwrap()
+        .into_raw()
+}
+
+#[no_mangle]
+/// Read back the writes to a stored relation, to follow them without running queries.
+/// Only the RocksDB engine supports this, and only for the writes made within
+/// its `change_feed_retention_secs` option.
+///
+/// `db_id`:    the ID representing the database.
+/// `relation`: the name of the stored relation.
+/// `since`:    the sequence number to read the writes from, as returned by the previous call.
+/// `limit`:    the maximum number of writes to return. With `0`, no writes are returned,
+///             only the sequence number following the latest write, to start from.
+///
+/// Returns a UTF-8-encoded C-string that **must** be freed with `cozo_free_str`. On success,
+/// its `changes` are objects with an `op` of `put`, `delete` or `clear`, a `seq` and the
+/// `row` put or the keys of the row deleted (named by `headers`), and its `next` is the
+/// sequence number to pass as `since` to get the writes that follow.
+pub unsafe extern "C" fn cozo_changes_since(
+    db_id: i32,
+    relation: *const c_char,
+    since: u64,
+    limit: u64,
+) -> *mut c_char {
+    let db = {
+        let db_ref = {
+            let dbs = HANDLES.dbs.lock().unwrap();
+            dbs.get(&db_id).cloned()
+        };
+        match db_ref {
+            None => {
+                return CString::new(r##"{"ok":false,"message":"database closed"}"##)
+                    .unwrap()
+                    .into_raw();
+            }
+            Some(db) => db,
+        }
+    };
+    let relation = match CStr::from_ptr(relation).to_str() {
+        Ok(p) => p,
+        Err(err) => return CString::new(format!("{err}")).unwrap().into_raw(),
+    };
+    CString::new(db.changes_since_str(relation, since, limit as usize))
+        .unwrap()
+        .into_raw()
+}
+
 /// Free any C-string returned from the Cozo C API.
 /// Must be called exactly once for each returned C-string.
 ///
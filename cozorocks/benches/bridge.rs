@@ -0,0 +1,473 @@
+/*
+ * Copyright 2022, The Cozo Project Authors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public License, v. 2.0.
+ * If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+//! Micro-benchmarks of the bridge calls on the hot paths of the storage engine.
+//!
+//! Run with `cargo bench -p cozorocks --bench bridge`. Each result is printed as a JSON object
+//! on a line of its own. Parameters are taken from the environment:
+//!
+//! * `COZOROCKS_BENCH_DIR`: where databases are created, defaults to the temporary directory
+//! * `COZOROCKS_BENCH_KEYS`: number of keys loaded, defaults to 1000000
+//! * `COZOROCKS_BENCH_OPS`: number of point reads or transactions per thread, defaults to 100000
+//! * `COZOROCKS_BENCH_VALUE_SIZES`: comma-separated value sizes in bytes, defaults to `16,256,4096`
+//! * `COZOROCKS_BENCH_THREADS`: comma-separated thread counts, defaults to one and all cores
+//! * `COZOROCKS_BENCH_BLOCK_CACHE`: block cache size in bytes, defaults to 64 MiB
+//! * `COZOROCKS_BENCH_ONLY`: comma-separated names of the benchmarks to run, defaults to all
+
+use std::env;
+use std::fs;
+use std::path::{Path, PathBuf};
+use std::str::FromStr;
+use std::thread;
+use std::time::{Duration, Instant};
+
+use cozorocks::{DbBuilder, RocksDb, RocksDbStatus, Tx};
+
+const BENCHES: [&str; 10] = [
+    "open",
+    "write_wal",
+    "write_no_wal",
+    "sst_ingest",
+    "point_get_hot",
+    "point_get_cold",
+    "scan_next",
+    "scan_batch",
+    "commit_contended",
+    "reopen",
+];
+const WRITE_TX_SIZE: usize = 100;
+const HOT_KEYS: u64 = 10000;
+const CONTENDED_KEYS: u64 = 16;
+const SCAN_BATCH_SIZE: usize = 1024;
+const SCAN_BATCH_BYTES: usize = 1 << 20;
+
+const LOADED_REL: u64 = 1;
+const WRITE_REL: u64 = 2;
+const INGEST_REL: u64 = 3;
+const COUNTER_REL: u64 = 4;
+
+struct Params {
+    dir: PathBuf,
+    keys: u64,
+    ops: u64,
+    value_sizes: Vec<usize>,
+    threads: Vec<usize>,
+    block_cache: usize,
+    only: Vec<String>,
+}
+
+fn env_list<T: FromStr>(name: &str, default: Vec<T>) -> Vec<T> {
+    match env::var(name) {
+        Ok(s) => s
+            .split(',')
+            .map(|part| {
+                part.trim()
+                    .parse()
+                    .unwrap_or_else(|_| panic!("bad value in {name}: {part}"))
+            })
+            .collect(),
+        Err(_) => default,
+    }
+}
+
+fn env_value<T: FromStr>(name: &str, default: T) -> T {
+    match env::var(name) {
+        Ok(s) => s
+            .trim()
+            .parse()
+            .unwrap_or_else(|_| panic!("bad value of {name}: {s}")),
+        Err(_) => default,
+    }
+}
+
+impl Params {
+    fn from_env() -> Self {
+        let cores = thread::available_parallelism()
+            .map(|n| n.get())
+            .unwrap_or(1);
+        let mut threads = vec![1];
+        if cores > 1 {
+            threads.push(cores);
+        }
+        Self {
+            dir: env::var("COZOROCKS_BENCH_DIR")
+                .map(PathBuf::from)
+                .unwrap_or_else(|_| env::temp_dir())
+                .join(format!("cozorocks_bench_{}", std::process::id())),
+            keys: env_value("COZOROCKS_BENCH_KEYS", 1000000),
+            ops: env_value("COZOROCKS_BENCH_OPS", 100000),
+            value_sizes: env_list("COZOROCKS_BENCH_VALUE_SIZES", vec![16, 256, 4096]),
+            threads: env_list("COZOROCKS_BENCH_THREADS", threads),
+            block_cache: env_value("COZOROCKS_BENCH_BLOCK_CACHE", 64 << 20),
+            only: env_list("COZOROCKS_BENCH_ONLY", vec![]),
+        }
+    }
+    fn enabled(&self, bench: &str) -> bool {
+        self.only.is_empty() || self.only.iter().any(|name| name == bench)
+    }
+}
+
+/// xorshift64*, so that runs are reproducible
+struct Rng(u64);
+
+impl Rng {
+    fn new(seed: u64) -> Self {
+        Self(seed.wrapping_mul(0x9E3779B97F4A7C15) | 1)
+    }
+    fn next(&mut self) -> u64 {
+        self.0 ^= self.0 >> 12;
+        self.0 ^= self.0 << 25;
+        self.0 ^= self.0 >> 27;
+        self.0.wrapping_mul(0x2545F4914F6CDD1D)
+    }
+    fn below(&mut self, n: u64) -> u64 {
+        self.next() % n
+    }
+}
+
+/// Keys look like those of stored relations: the big-endian relation id followed by the row
+fn key(rel: u64, i: u64) -> [u8; 16] {
+    let mut ret = [0; 16];
+    ret[..8].copy_from_slice(&rel.to_be_bytes());
+    ret[8..].copy_from_slice(&i.to_be_bytes());
+    ret
+}
+
+fn value(rng: &mut Rng, size: usize) -> Vec<u8> {
+    // half random bytes, half zeros, so that values compress about as well as real ones
+    let mut ret = vec![0; size];
+    for b in ret.iter_mut().take(size / 2) {
+        *b = rng.next() as u8;
+    }
+    ret
+}
+
+fn open(path: &Path, params: &Params) -> RocksDb {
+    DbBuilder::default()
+        .path(path)
+        .create_if_missing(true)
+        .use_capped_prefix_extractor(true, 9)
+        .use_bloom_filter(true, 9.9, true)
+        .block_cache(params.block_cache, false)
+        .build()
+        .expect("cannot open database")
+}
+
+struct Measurement {
+    bench: &'static str,
+    value_size: usize,
+    threads: usize,
+    ops: u64,
+    elapsed: Duration,
+    bytes: u64,
+    latencies: Vec<Duration>,
+}
+
+impl Measurement {
+    fn new(bench: &'static str, value_size: usize, threads: usize) -> Self {
+        Self {
+            bench,
+            value_size,
+            threads,
+            ops: 0,
+            elapsed: Duration::ZERO,
+            bytes: 0,
+            latencies: vec![],
+        }
+    }
+    fn print(mut self) {
+        let secs = self.elapsed.as_secs_f64();
+        let mut line = format!(
+            r#"{{"bench":"{}","value_size":{},"threads":{},"ops":{},"secs":{:.6},"ops_per_sec":{:.1},"mb_per_sec":{:.3}"#,
+            self.bench,
+            self.value_size,
+            self.threads,
+            self.ops,
+            secs,
+            self.ops as f64 / secs,
+            self.bytes as f64 / secs / (1 << 20) as f64
+        );
+        if !self.latencies.is_empty() {
+            self.latencies.sort();
+            let percentile = |p: f64| {
+                let idx = ((self.latencies.len() - 1) as f64 * p) as usize;
+                self.latencies[idx].as_secs_f64() * 1e6
+            };
+            line.push_str(&format!(
+                r#","p50_us":{:.1},"p99_us":{:.1},"p999_us":{:.1},"max_us":{:.1}"#,
+                percentile(0.5),
+                percentile(0.99),
+                percentile(0.999),
+                percentile(1.0)
+            ));
+        }
+        line.push('}');
+        println!("{line}");
+    }
+}
+
+/// Runs `f(thread_idx)` on `threads` threads at once, returning the time until all are done
+/// and whatever they return
+fn run_threads<T: Send>(threads: usize, f: impl Fn(usize) -> T + Sync) -> (Duration, Vec<T>) {
+    let f = &f;
+    let start = Instant::now();
+    let results = thread::scope(|s| {
+        let handles: Vec<_> = (0..threads).map(|i| s.spawn(move || f(i))).collect();
+        handles.into_iter().map(|h| h.join().unwrap()).collect()
+    });
+    (start.elapsed(), results)
+}
+
+fn load(db: &RocksDb, params: &Params, value_size: usize) {
+    let mut rng = Rng::new(value_size as u64);
+    let mut tx = db.transact().disable_wal(true).start();
+    for i in 0..params.keys {
+        tx.put(&key(LOADED_REL, i), &value(&mut rng, value_size))
+            .unwrap();
+        if (i + 1) % 10000 == 0 {
+            tx.commit().unwrap();
+            tx = db.transact().disable_wal(true).start();
+        }
+    }
+    tx.commit().unwrap();
+    db.range_compact(&key(LOADED_REL, 0), &key(LOADED_REL + 1, 0))
+        .unwrap();
+}
+
+fn bench_writes(
+    db: &RocksDb,
+    params: &Params,
+    bench: &'static str,
+    value_size: usize,
+    threads: usize,
+) {
+    let disable_wal = bench == "write_no_wal";
+    let per_thread = params.ops;
+    let (elapsed, _) = run_threads(threads, |t| {
+        let mut rng = Rng::new(t as u64);
+        let base = t as u64 * per_thread;
+        let mut i = 0;
+        while i < per_thread {
+            let mut tx = db.transact().disable_wal(disable_wal).start();
+            for _ in 0..WRITE_TX_SIZE.min((per_thread - i) as usize) {
+                tx.put(&key(WRITE_REL, base + i), &value(&mut rng, value_size))
+                    .unwrap();
+                i += 1;
+            }
+            tx.commit().unwrap();
+        }
+    });
+    let mut m = Measurement::new(bench, value_size, threads);
+    m.ops = per_thread * threads as u64;
+    m.bytes = m.ops * (16 + value_size) as u64;
+    m.elapsed = elapsed;
+    m.print();
+    db.range_del(&key(WRITE_REL, 0), &key(WRITE_REL + 1, 0))
+        .unwrap();
+}
+
+fn bench_sst_ingest(db: &RocksDb, params: &Params, dir: &Path, value_size: usize) {
+    let mut rng = Rng::new(value_size as u64);
+    let path = dir.join("ingest.sst");
+    let path = path.to_str().unwrap();
+    let start = Instant::now();
+    let mut writer = db.get_sst_writer(path).unwrap();
+    for i in 0..params.keys {
+        writer
+            .put(&key(INGEST_REL, i), &value(&mut rng, value_size))
+            .unwrap();
+    }
+    writer.finish().unwrap();
+    db.ingest_sst_files(&[path.to_string()], true, true)
+        .unwrap();
+    let mut m = Measurement::new("sst_ingest", value_size, 1);
+    m.elapsed = start.elapsed();
+    m.ops = params.keys;
+    m.bytes = m.ops * (16 + value_size) as u64;
+    m.print();
+    db.range_del(&key(INGEST_REL, 0), &key(INGEST_REL + 1, 0))
+        .unwrap();
+}
+
+fn bench_point_gets(
+    db: &RocksDb,
+    params: &Params,
+    bench: &'static str,
+    value_size: usize,
+    threads: usize,
+) {
+    let hot = bench == "point_get_hot";
+    // hot reads go to a working set that fits in the block cache after the first pass,
+    // cold reads are spread over all keys and bypass the block cache (but not the OS page cache)
+    let key_space = if hot {
+        HOT_KEYS.min(params.keys)
+    } else {
+        params.keys
+    };
+    if hot {
+        let tx = db.transact_read_only();
+        for i in 0..key_space {
+            tx.get(&key(LOADED_REL, i), false).unwrap();
+        }
+    }
+    let (elapsed, found) = run_threads(threads, |t| {
+        let mut rng = Rng::new(1000 + t as u64);
+        let tx = db.transact().fill_cache(hot).start();
+        let mut found = 0u64;
+        for _ in 0..params.ops {
+            if tx
+                .get(&key(LOADED_REL, rng.below(key_space)), false)
+                .unwrap()
+                .is_some()
+            {
+                found += 1;
+            }
+        }
+        found
+    });
+    assert_eq!(found.iter().sum::<u64>(), params.ops * threads as u64);
+    let mut m = Measurement::new(bench, value_size, threads);
+    m.ops = params.ops * threads as u64;
+    m.bytes = m.ops * value_size as u64;
+    m.elapsed = elapsed;
+    m.print();
+}
+
+fn bench_scans(db: &RocksDb, bench: &'static str, value_size: usize, threads: usize) {
+    let lower = key(LOADED_REL, 0);
+    let upper = key(LOADED_REL + 1, 0);
+    let parts = db.split_range(&lower, &upper, threads);
+    let (elapsed, counts) = run_threads(parts.len(), |t| {
+        let (part_lower, part_upper) = &parts[t];
+        let tx = db.transact_read_only();
+        let mut it = tx
+            .iterator()
+            .lower_bound(part_lower)
+            .upper_bound(part_upper)
+            .start();
+        it.seek(part_lower);
+        let mut rows = 0u64;
+        let mut bytes = 0u64;
+        if bench == "scan_next" {
+            while let Some((k, v)) = it.pair().unwrap() {
+                rows += 1;
+                bytes += (k.len() + v.len()) as u64;
+                it.next();
+            }
+        } else {
+            loop {
+                let batch = it.next_batch(SCAN_BATCH_SIZE, SCAN_BATCH_BYTES).unwrap();
+                if batch.is_empty() {
+                    break;
+                }
+                for (k, v) in batch {
+                    rows += 1;
+                    bytes += (k.len() + v.len()) as u64;
+                }
+            }
+        }
+        (rows, bytes)
+    });
+    let mut m = Measurement::new(bench, value_size, parts.len());
+    m.ops = counts.iter().map(|(rows, _)| rows).sum();
+    m.bytes = counts.iter().map(|(_, bytes)| bytes).sum();
+    m.elapsed = elapsed;
+    m.print();
+}
+
+fn read_modify_write(tx: &mut Tx, k: &[u8], val: &[u8]) -> Result<(), RocksDbStatus> {
+    tx.get(k, true)?;
+    tx.put(k, val)?;
+    tx.commit()
+}
+
+/// Read-modify-write transactions on a few hot keys, retried on lock timeouts and conflicts
+fn bench_contended_commits(db: &RocksDb, params: &Params, value_size: usize, threads: usize) {
+    let (elapsed, latencies) = run_threads(threads, |t| {
+        let mut rng = Rng::new(2000 + t as u64);
+        let mut latencies = Vec::with_capacity(params.ops as usize);
+        for _ in 0..params.ops {
+            let k = key(COUNTER_REL, rng.below(CONTENDED_KEYS));
+            let val = value(&mut rng, value_size);
+            let start = Instant::now();
+            loop {
+                let mut tx = db.transact().set_snapshot(true).start();
+                if read_modify_write(&mut tx, &k, &val).is_ok() {
+                    break;
+                }
+                let _ = tx.rollback();
+            }
+            latencies.push(start.elapsed());
+        }
+        latencies
+    });
+    let mut m = Measurement::new("commit_contended", value_size, threads);
+    m.ops = params.ops * threads as u64;
+    m.elapsed = elapsed;
+    m.latencies = latencies.into_iter().flatten().collect();
+    m.print();
+}
+
+fn main() {
+    let params = Params::from_env();
+    for name in &params.only {
+        assert!(BENCHES.contains(&name.as_str()), "unknown benchmark {name}");
+    }
+    for &value_size in &params.value_sizes {
+        let dir = params.dir.join(format!("v{value_size}"));
+        let _ = fs::remove_dir_all(&dir);
+        fs::create_dir_all(&dir).unwrap();
+        let db_path = dir.join("db");
+
+        let start = Instant::now();
+        let db = open(&db_path, &params);
+        if params.enabled("open") {
+            let mut m = Measurement::new("open", value_size, 1);
+            m.ops = 1;
+            m.elapsed = start.elapsed();
+            m.print();
+        }
+        load(&db, &params, value_size);
+
+        for &threads in &params.threads {
+            for bench in ["write_wal", "write_no_wal"] {
+                if params.enabled(bench) {
+                    bench_writes(&db, &params, bench, value_size, threads);
+                }
+            }
+            for bench in ["point_get_hot", "point_get_cold"] {
+                if params.enabled(bench) {
+                    bench_point_gets(&db, &params, bench, value_size, threads);
+                }
+            }
+            for bench in ["scan_next", "scan_batch"] {
+                if params.enabled(bench) {
+                    bench_scans(&db, bench, value_size, threads);
+                }
+            }
+            if params.enabled("commit_contended") {
+                bench_contended_commits(&db, &params, value_size, threads);
+            }
+        }
+        if params.enabled("sst_ingest") {
+            bench_sst_ingest(&db, &params, &dir, value_size);
+        }
+
+        drop(db);
+        if params.enabled("reopen") {
+            let start = Instant::now();
+            let db = open(&db_path, &params);
+            let mut m = Measurement::new("reopen", value_size, 1);
+            m.ops = 1;
+            m.elapsed = start.elapsed();
+            m.print();
+            drop(db);
+        }
+        let _ = fs::remove_dir_all(&dir);
+    }
+}
@@ -13,5 +13,6 @@
 #include "status.h"
 #include "opts.h"
 #include "iter.h"
+#include "cf.h"
 
 #endif //COZOROCKS_BRIDGE_H
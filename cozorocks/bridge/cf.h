@@ -0,0 +1,200 @@
+// Copyright 2022, The Cozo Project Authors.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License, v. 2.0.
+// If a copy of the MPL was not distributed with this file,
+// You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef COZOROCKS_CF_H
+#define COZOROCKS_CF_H
+
+#include <algorithm>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "common.h"
+
+// Name of the (empty) column family marking a database that stores each relation in its own column family
+static const string RELATION_CFS_MARKER = "cozo_relation_cfs";
+static const string RELATION_CF_PREFIX = "rel_";
+static const size_t RELATION_ID_LEN = 8;
+
+inline string relation_cf_name(uint64_t rel_id) {
+    return RELATION_CF_PREFIX + to_string(rel_id);
+}
+
+// Returns false if `name` is not the name of a relation column family
+inline bool parse_relation_cf_name(const string &name, uint64_t &rel_id) {
+    if (name.size() <= RELATION_CF_PREFIX.size() || name.compare(0, RELATION_CF_PREFIX.size(), RELATION_CF_PREFIX) != 0) {
+        return false;
+    }
+    rel_id = 0;
+    for (size_t i = RELATION_CF_PREFIX.size(); i < name.size(); ++i) {
+        auto c = name[i];
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        rel_id = rel_id * 10 + (c - '0');
+    }
+    return true;
+}
+
+// Keys start with the big-endian relation id
+inline bool relation_id_of_key(const Slice &key, uint64_t &rel_id) {
+    if (key.size() < RELATION_ID_LEN) {
+        return false;
+    }
+    rel_id = 0;
+    for (size_t i = 0; i < RELATION_ID_LEN; ++i) {
+        rel_id = (rel_id << 8) | static_cast<uint8_t>(key[i]);
+    }
+    return true;
+}
+
+// Routes keys to the column family of their relation. Relations without a column family of their
+// own (this includes the system relation) live in the default column family.
+struct RelationColumnFamilies {
+    DB *db;
+    ColumnFamilyHandle *default_cf;
+    ColumnFamilyOptions cf_options;
+    mutable std::shared_mutex mutex;
+    unordered_map<uint64_t, ColumnFamilyHandle *> handles;
+    // handles of dropped column families are kept until the database closes,
+    // since transactions started before the drop may still be reading through them
+    vector<ColumnFamilyHandle *> dropped;
+
+    RelationColumnFamilies(DB *db_, ColumnFamilyOptions cf_options_) :
+            db(db_), default_cf(db_->DefaultColumnFamily()), cf_options(std::move(cf_options_)) {}
+
+    RelationColumnFamilies(const RelationColumnFamilies &) = delete;
+
+    ~RelationColumnFamilies() {
+        for (auto &kv: handles) {
+            db->DestroyColumnFamilyHandle(kv.second);
+        }
+        for (auto handle: dropped) {
+            db->DestroyColumnFamilyHandle(handle);
+        }
+    }
+
+    inline void add(uint64_t rel_id, ColumnFamilyHandle *handle) {
+        std::unique_lock lock(mutex);
+        handles[rel_id] = handle;
+    }
+
+    static inline bool intersects(uint64_t rel_id, const Slice &lower, const Slice &upper) {
+        char prefix[RELATION_ID_LEN];
+        char next_prefix[RELATION_ID_LEN];
+        for (size_t i = 0; i < RELATION_ID_LEN; ++i) {
+            auto shift = 8 * (RELATION_ID_LEN - 1 - i);
+            prefix[i] = static_cast<char>((rel_id >> shift) & 0xFF);
+            next_prefix[i] = static_cast<char>(((rel_id + 1) >> shift) & 0xFF);
+        }
+        return Slice(next_prefix, RELATION_ID_LEN).compare(lower) > 0 &&
+               Slice(prefix, RELATION_ID_LEN).compare(upper) < 0;
+    }
+
+    [[nodiscard]] inline ColumnFamilyHandle *for_key(const Slice &key) const {
+        uint64_t rel_id;
+        if (!relation_id_of_key(key, rel_id)) {
+            return default_cf;
+        }
+        std::shared_lock lock(mutex);
+        auto found = handles.find(rel_id);
+        if (found == handles.end()) {
+            return default_cf;
+        }
+        return found->second;
+    }
+
+    // Same as `for_key`, but creates the column family of the relation if it does not exist yet
+    inline ColumnFamilyHandle *for_write(const Slice &key, Status &status) {
+        uint64_t rel_id;
+        if (!relation_id_of_key(key, rel_id) || rel_id == 0) {
+            return default_cf;
+        }
+        {
+            std::shared_lock lock(mutex);
+            auto found = handles.find(rel_id);
+            if (found != handles.end()) {
+                return found->second;
+            }
+        }
+        return create(rel_id, cf_options, status);
+    }
+
+    inline ColumnFamilyHandle *create(uint64_t rel_id, const ColumnFamilyOptions &options, Status &status) {
+        std::unique_lock lock(mutex);
+        auto found = handles.find(rel_id);
+        if (found != handles.end()) {
+            return found->second;
+        }
+        ColumnFamilyHandle *handle = nullptr;
+        status = db->CreateColumnFamily(options, relation_cf_name(rel_id), &handle);
+        if (!status.ok()) {
+            return default_cf;
+        }
+        handles[rel_id] = handle;
+        return handle;
+    }
+
+    inline Status drop(uint64_t rel_id) {
+        std::unique_lock lock(mutex);
+        auto found = handles.find(rel_id);
+        if (found == handles.end()) {
+            return Status::OK();
+        }
+        auto s = db->DropColumnFamily(found->second);
+        if (s.ok()) {
+            dropped.push_back(found->second);
+            handles.erase(found);
+        }
+        return s;
+    }
+
+    // Ids of the relations with their own column family whose key range intersects `[lower, upper)`, sorted
+    [[nodiscard]] inline rust::Vec<uint64_t> in_range(const Slice &lower, const Slice &upper) const {
+        vector<uint64_t> ids;
+        {
+            std::shared_lock lock(mutex);
+            for (auto &kv: handles) {
+                if (intersects(kv.first, lower, upper)) {
+                    ids.push_back(kv.first);
+                }
+            }
+        }
+        std::sort(ids.begin(), ids.end());
+        rust::Vec<uint64_t> ret;
+        ret.reserve(ids.size());
+        for (auto id: ids) {
+            ret.push_back(id);
+        }
+        return ret;
+    }
+
+    // The default column family followed by those of the relations intersecting `[lower, upper)`
+    [[nodiscard]] inline vector<ColumnFamilyHandle *> handles_in_range(const Slice &lower, const Slice &upper) const {
+        std::shared_lock lock(mutex);
+        vector<ColumnFamilyHandle *> ret;
+        ret.push_back(default_cf);
+        for (auto &kv: handles) {
+            if (intersects(kv.first, lower, upper)) {
+                ret.push_back(kv.second);
+            }
+        }
+        return ret;
+    }
+
+    [[nodiscard]] inline vector<ColumnFamilyHandle *> all() const {
+        std::shared_lock lock(mutex);
+        vector<ColumnFamilyHandle *> ret;
+        ret.reserve(handles.size() + 1);
+        ret.push_back(default_cf);
+        for (auto &kv: handles) {
+            ret.push_back(kv.second);
+        }
+        return ret;
+    }
+};
+
+#endif //COZOROCKS_CF_H
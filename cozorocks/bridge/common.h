@@ -11,6 +11,8 @@
 #include "rocksdb/db.h"
 #include "rocksdb/slice.h"
 #include "rocksdb/options.h"
+#include "rocksdb/cache.h"
+#include "rocksdb/convenience.h"
 #include "rocksdb/utilities/transaction.h"
 #include "rocksdb/utilities/transaction_db.h"
 #include "rocksdb/utilities/optimistic_transaction_db.h"
@@ -23,6 +25,9 @@ using namespace std;
 
 struct RocksDbStatus;
 struct DbOpts;
+struct DbStat;
+struct SplitKey;
+struct ChangeRecord;
 
 typedef Status::Code StatusCode;
 typedef Status::SubCode StatusSubCode;
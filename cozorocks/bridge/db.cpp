@@ -4,9 +4,21 @@
 // If a copy of the MPL was not distributed with this file,
 // You can obtain one at https://mozilla.org/MPL/2.0/.
 
+#include <algorithm>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 #include "db.h"
+#include "rocksdb/statistics.h"
+#include "rocksdb/rate_limiter.h"
+#include "rocksdb/write_buffer_manager.h"
+#include "rocksdb/utilities/object_registry.h"
+#include "rocksdb/utilities/checkpoint.h"
+#include "rocksdb/utilities/backup_engine.h"
+#include "prefix.h"
+#include "merge.h"
 #include "cozorocks/src/bridge/mod.rs.h"
 #include "rocksdb/utilities/options_util.h"
 
@@ -53,13 +65,221 @@ ColumnFamilyOptions default_cf_options() {
     return options;
 }
 
+template<typename T>
+inline bool is_expired(const weak_ptr<T> &shared) {
+    return shared.expired();
+}
+
+// the secondary cache is owned by the block cache in front of it
+template<typename T, typename U>
+inline bool is_expired(const pair<weak_ptr<T>, weak_ptr<U>> &shared) {
+    return shared.first.expired();
+}
+
+// Drops the entries of the objects shared by name that no database uses any more,
+// so that opening and closing databases under ever new names does not grow the registry
+template<typename Map>
+void erase_expired(Map &shared) {
+    for (auto it = shared.begin(); it != shared.end();) {
+        if (is_expired(it->second)) {
+            it = shared.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+static std::mutex SHARED_BLOCK_CACHES_MUTEX;
+static std::unordered_map<string, pair<weak_ptr<Cache>, weak_ptr<SecondaryCache>>> SHARED_BLOCK_CACHES;
+
+// Blocks evicted from the block cache go to the secondary cache, and blocks missing from the
+// block cache are looked up there before being read from the SST files. The compressed in-memory
+// tier is built in. Other tiers, such as those on local SSDs, come from libraries registering them
+// with the object registry, and are given by their URI.
+shared_ptr<SecondaryCache> new_secondary_cache(const DbOpts &opts, Status &status) {
+    if (!opts.secondary_cache_uri.empty()) {
+        ConfigOptions config_options;
+        shared_ptr<SecondaryCache> ret;
+        status = SecondaryCache::CreateFromString(config_options, string(opts.secondary_cache_uri), &ret);
+        return ret;
+    }
+    if (opts.secondary_cache_size == 0) {
+        return nullptr;
+    }
+    CompressedSecondaryCacheOptions cache_opts;
+    cache_opts.capacity = opts.secondary_cache_size;
+    return NewCompressedSecondaryCache(cache_opts);
+}
+
+shared_ptr<Cache> new_block_cache(const DbOpts &opts, shared_ptr<SecondaryCache> &secondary, Status &status) {
+    if (opts.block_cache_hyper_clock) {
+        // the estimated entry charge should be close to the block size
+        HyperClockCacheOptions cache_opts(opts.block_cache_size, 16 * 1024);
+        return cache_opts.MakeSharedCache();
+    }
+    secondary = new_secondary_cache(opts, status);
+    if (!status.ok()) {
+        return nullptr;
+    }
+    LRUCacheOptions cache_opts;
+    cache_opts.capacity = opts.block_cache_size;
+    cache_opts.secondary_cache = secondary;
+    return NewLRUCache(cache_opts);
+}
+
+// Databases opened with the same non-empty `shared_block_cache` name share a single cache,
+// which is created with the options of the first database to open it and lives as long as
+// any database still uses it.
+shared_ptr<Cache> get_block_cache(const DbOpts &opts, shared_ptr<SecondaryCache> &secondary, Status &status) {
+    if (opts.block_cache_size == 0) {
+        return nullptr;
+    }
+    if (opts.shared_block_cache.empty()) {
+        return new_block_cache(opts, secondary, status);
+    }
+    string name(opts.shared_block_cache);
+    std::lock_guard<std::mutex> guard(SHARED_BLOCK_CACHES_MUTEX);
+    erase_expired(SHARED_BLOCK_CACHES);
+    auto &entry = SHARED_BLOCK_CACHES[name];
+    auto found = entry.first.lock();
+    if (found == nullptr) {
+        found = new_block_cache(opts, secondary, status);
+        entry = {found, secondary};
+    } else {
+        secondary = entry.second.lock();
+    }
+    return found;
+}
+
+static std::mutex SHARED_BLOB_CACHES_MUTEX;
+static std::unordered_map<string, weak_ptr<Cache>> SHARED_BLOB_CACHES;
+
+// Large values are cached apart from the blocks, so that reading them does not evict index and
+// data blocks. Shared by name between databases in the same way as block caches.
+shared_ptr<Cache> get_blob_cache(const DbOpts &opts) {
+    if (opts.blob_cache_size == 0) {
+        return nullptr;
+    }
+    if (opts.shared_blob_cache.empty()) {
+        return NewLRUCache(opts.blob_cache_size);
+    }
+    string name(opts.shared_blob_cache);
+    std::lock_guard<std::mutex> guard(SHARED_BLOB_CACHES_MUTEX);
+    erase_expired(SHARED_BLOB_CACHES);
+    auto found = SHARED_BLOB_CACHES[name].lock();
+    if (found == nullptr) {
+        found = NewLRUCache(opts.blob_cache_size);
+        SHARED_BLOB_CACHES[name] = found;
+    }
+    return found;
+}
+
+bool parse_compression_type(const string &name, CompressionType &compression) {
+    static const unordered_map<string, CompressionType> COMPRESSION_TYPES = {
+            {"none",   kNoCompression},
+            {"snappy", kSnappyCompression},
+            {"zlib",   kZlibCompression},
+            {"lz4",    kLZ4Compression},
+            {"lz4hc",  kLZ4HCCompression},
+            {"zstd",   kZSTD},
+    };
+    auto found = COMPRESSION_TYPES.find(name);
+    if (found == COMPRESSION_TYPES.end()) {
+        return false;
+    }
+    compression = found->second;
+    return true;
+}
+
+void register_key_columns_prefix_transform() {
+    static std::once_flag once;
+    std::call_once(once, [] {
+        ObjectLibrary::Default()->AddFactory<const SliceTransform>(
+                ObjectLibrary::PatternEntry(KeyColumnsPrefixTransform::kClassName(), false).AddNumber("."),
+                [](const std::string &uri, std::unique_ptr<const SliceTransform> *guard, std::string *) {
+                    auto n_columns = std::stoull(uri.substr(strlen(KeyColumnsPrefixTransform::kClassName()) + 1));
+                    guard->reset(new KeyColumnsPrefixTransform(n_columns));
+                    return guard->get();
+                });
+    });
+}
+
+static std::mutex SHARED_WRITE_BUFFER_MANAGERS_MUTEX;
+static std::unordered_map<string, weak_ptr<WriteBufferManager>> SHARED_WRITE_BUFFER_MANAGERS;
+
+// Caps the memory of the memtables over all column families, flushing the largest ones once the
+// budget is reached. Shared by name between databases in the same way as block caches.
+shared_ptr<WriteBufferManager> get_write_buffer_manager(const DbOpts &opts, const shared_ptr<Cache> &cache) {
+    if (opts.write_buffer_budget == 0) {
+        return nullptr;
+    }
+    auto charged_cache = opts.write_buffer_cost_to_cache ? cache : nullptr;
+    if (opts.shared_write_buffer_budget.empty()) {
+        return make_shared<WriteBufferManager>(opts.write_buffer_budget, charged_cache);
+    }
+    string name(opts.shared_write_buffer_budget);
+    std::lock_guard<std::mutex> guard(SHARED_WRITE_BUFFER_MANAGERS_MUTEX);
+    erase_expired(SHARED_WRITE_BUFFER_MANAGERS);
+    auto found = SHARED_WRITE_BUFFER_MANAGERS[name].lock();
+    if (found == nullptr) {
+        found = make_shared<WriteBufferManager>(opts.write_buffer_budget, charged_cache);
+        SHARED_WRITE_BUFFER_MANAGERS[name] = found;
+    }
+    return found;
+}
+
+// Starts from the table options already in `options` (the tuned defaults, or those from
+// the options file) and only changes what `opts` asks for, so that the settings compose.
+BlockBasedTableOptions
+build_table_options(const Options &options, const DbOpts &opts, const shared_ptr<Cache> &cache) {
+    BlockBasedTableOptions table_options;
+    auto *existing = options.table_factory->GetOptions<BlockBasedTableOptions>();
+    if (existing != nullptr) {
+        table_options = *existing;
+    }
+    if (cache != nullptr) {
+        table_options.block_cache = cache;
+    }
+    if (opts.table_block_size > 0) {
+        table_options.block_size = opts.table_block_size;
+    }
+    if (opts.use_ribbon_filter) {
+        table_options.filter_policy.reset(NewRibbonFilterPolicy(opts.bloom_filter_bits_per_key));
+        table_options.whole_key_filtering = opts.bloom_filter_whole_key_filtering;
+    } else if (opts.use_bloom_filter) {
+        table_options.filter_policy.reset(NewBloomFilterPolicy(opts.bloom_filter_bits_per_key, false));
+        table_options.whole_key_filtering = opts.bloom_filter_whole_key_filtering;
+    }
+    if (opts.partitioned_index_filters) {
+        table_options.index_type = BlockBasedTableOptions::IndexType::kTwoLevelIndexSearch;
+        table_options.partition_filters = true;
+        table_options.metadata_block_size = 4096;
+        table_options.cache_index_and_filter_blocks_with_high_priority = true;
+        table_options.pin_top_level_index_and_filter = true;
+    }
+    if (opts.data_block_hash_index) {
+        table_options.data_block_index_type = BlockBasedTableOptions::DataBlockIndexType::kDataBlockBinaryAndHash;
+        table_options.data_block_hash_table_util_ratio = opts.data_block_hash_table_util_ratio;
+    }
+    return table_options;
+}
+
 shared_ptr <RocksDbBridge> open_db(const DbOpts &opts, RocksDbStatus &status) {
+    register_key_columns_prefix_transform();
     auto options = default_db_options();
 
-    shared_ptr<Cache> cache = nullptr;
-
-    if (opts.block_cache_size > 0) {
-        cache = NewLRUCache(1 * 1024 * 1024 * 1024);
+    bool has_secondary_cache = opts.secondary_cache_size > 0 || !opts.secondary_cache_uri.empty();
+    if (has_secondary_cache && (opts.block_cache_size == 0 || opts.block_cache_hyper_clock)) {
+        write_status(Status::InvalidArgument("secondary caches need a block cache of a given size using LRU"),
+                     status);
+        return nullptr;
+    }
+    shared_ptr<SecondaryCache> secondary_cache;
+    Status cache_status;
+    shared_ptr<Cache> cache = get_block_cache(opts, secondary_cache, cache_status);
+    if (!cache_status.ok()) {
+        write_status(cache_status, status);
+        return nullptr;
     }
 
     if (!opts.options_path.empty()) {
@@ -74,15 +294,6 @@ shared_ptr <RocksDbBridge> open_db(const DbOpts &opts, RocksDbStatus &status) {
             return nullptr;
         }
 
-        if (cache != nullptr) {
-            for (size_t i = 0; i < loaded_cf_descs.size(); ++i) {
-                auto* loaded_bbt_opt =
-                        loaded_cf_descs[0]
-                                .options.table_factory->GetOptions<BlockBasedTableOptions>();
-                loaded_bbt_opt->block_cache = cache;
-            }
-        }
-
         options = Options(loaded_db_opt, loaded_cf_descs[0].options);
     }
 
@@ -105,44 +316,616 @@ shared_ptr <RocksDbBridge> open_db(const DbOpts &opts, RocksDbStatus &status) {
         options.blob_file_size = opts.blob_file_size;
 
         options.enable_blob_garbage_collection = opts.enable_blob_garbage_collection;
+
+        if (opts.blob_garbage_collection_age_cutoff >= 0) {
+            options.blob_garbage_collection_age_cutoff = opts.blob_garbage_collection_age_cutoff;
+        }
+        options.blob_file_starting_level = opts.blob_file_starting_level;
     }
-    if (opts.use_bloom_filter) {
-        BlockBasedTableOptions table_options;
-        table_options.filter_policy.reset(NewBloomFilterPolicy(opts.bloom_filter_bits_per_key, false));
-        table_options.whole_key_filtering = opts.bloom_filter_whole_key_filtering;
-        options.table_factory.reset(NewBlockBasedTableFactory(table_options));
+    if (!opts.blob_compression.empty()) {
+        CompressionType compression;
+        if (!parse_compression_type(string(opts.blob_compression), compression)) {
+            write_status(Status::InvalidArgument("unknown blob compression: " + string(opts.blob_compression)),
+                         status);
+            return nullptr;
+        }
+        options.blob_compression_type = compression;
+    }
+    // set even without blob files, for column families enabling them in their own options
+    shared_ptr<Cache> blob_cache = get_blob_cache(opts);
+    if (blob_cache != nullptr) {
+        options.blob_cache = blob_cache;
+        if (opts.prepopulate_blob_cache) {
+            options.prepopulate_blob_cache = PrepopulateBlobCache::kFlushOnly;
+        }
     }
+    options.table_factory.reset(NewBlockBasedTableFactory(build_table_options(options, opts, cache)));
     if (opts.use_capped_prefix_extractor) {
         options.prefix_extractor.reset(NewCappedPrefixTransform(opts.capped_prefix_extractor_len));
     }
     if (opts.use_fixed_prefix_extractor) {
         options.prefix_extractor.reset(NewFixedPrefixTransform(opts.fixed_prefix_extractor_len));
     }
+    if (opts.use_key_columns_prefix_extractor) {
+        options.prefix_extractor = make_shared<KeyColumnsPrefixTransform>(opts.key_columns_prefix_extractor_len);
+    }
     options.create_missing_column_families = true;
+    if (opts.max_open_files != 0) {
+        // SST files beyond this are opened when read, instead of all of them when the database opens
+        options.max_open_files = opts.max_open_files;
+    }
+    if (opts.max_file_opening_threads > 0) {
+        options.max_file_opening_threads = opts.max_file_opening_threads;
+    }
+    if (opts.fast_open) {
+        // these read the properties or stat each SST file when opening
+        options.skip_stats_update_on_db_open = true;
+        options.skip_checking_sst_file_sizes_on_db_open = true;
+        // files becoming obsolete are deleted in the background instead of by the thread making them so
+        options.avoid_unnecessary_blocking_io = true;
+    }
+    options.enable_pipelined_write = opts.enable_pipelined_write;
+    // change feeds read the WAL files, which are then kept around for a while once obsolete
+    if (opts.wal_ttl_seconds > 0) {
+        options.WAL_ttl_seconds = opts.wal_ttl_seconds;
+    }
+    if (opts.wal_size_limit_mb > 0) {
+        options.WAL_size_limit_MB = opts.wal_size_limit_mb;
+    }
+    if (opts.enable_statistics) {
+        options.statistics = CreateDBStatistics();
+    }
+    if (opts.rate_limit_bytes_per_sec > 0) {
+        // flushes and compactions only, reads and foreground writes are never throttled
+        options.rate_limiter.reset(NewGenericRateLimiter(
+                static_cast<int64_t>(opts.rate_limit_bytes_per_sec), 100 * 1000, 10,
+                RateLimiter::Mode::kWritesOnly, opts.rate_limit_auto_tuned));
+    }
+    options.write_buffer_manager = get_write_buffer_manager(opts, cache);
+    auto stall_listener = make_shared<WriteStallListener>();
+    options.listeners.push_back(stall_listener);
+    // does nothing until relations are registered, see `set_validity_retention`
+    auto validity_retention = make_shared<ValidityRetentionFilterFactory>();
+    options.compaction_filter_factory = validity_retention;
+    options.merge_operator = make_shared<CozoMergeOperator>();
 
     shared_ptr <RocksDbBridge> db = make_shared<RocksDbBridge>();
 
     db->db_path = convert_vec_to_string(opts.db_path);
+    db->block_cache = cache;
+    db->secondary_cache = secondary_cache;
+    db->blob_cache = blob_cache;
+    db->statistics = options.statistics;
+    db->stall_listener = stall_listener;
+    db->validity_retention = validity_retention;
 
-    TransactionDB *txn_db = nullptr;
-    write_status(
-            TransactionDB::Open(options, TransactionDBOptions(), db->db_path, &txn_db),
-            status);
-    db->db.reset(txn_db);
     db->destroy_on_exit = opts.destroy_on_exit;
 
+    vector<string> existing_cfs;
+    bool is_new = !DB::ListColumnFamilies(options, db->db_path, &existing_cfs).ok();
+    bool relation_cfs = opts.relation_column_families && is_new;
+    for (auto &name: existing_cfs) {
+        if (name == RELATION_CFS_MARKER) {
+            relation_cfs = true;
+        }
+    }
+    if (opts.relation_column_families && !relation_cfs) {
+        write_status(Status::InvalidArgument(
+                "column families per relation can only be enabled when the database is created"), status);
+        return nullptr;
+    }
+
+    bool read_only = opts.read_only || !opts.secondary_path.empty();
+    if (read_only && is_new) {
+        write_status(Status::InvalidArgument("only existing databases can be opened read-only or as secondaries"),
+                     status);
+        return nullptr;
+    }
+    db->secondary = !opts.secondary_path.empty();
+    if (db->secondary) {
+        // secondaries must keep all files open, since the primary may delete them at any time
+        options.max_open_files = -1;
+    }
+
+    if (opts.large_transactions && opts.optimistic_transactions) {
+        write_status(Status::InvalidArgument("large transactions cannot be optimistic"), status);
+        return nullptr;
+    }
+    db->tx_write_buffer_limit = opts.tx_write_buffer_limit;
+    db->large_transactions = opts.large_transactions;
+    TransactionDBOptions txn_db_options;
+    if (opts.large_transactions) {
+        // Transactions write what they buffer beyond the limit into the database before committing.
+        // Databases written to this way cannot be opened again without it while their WAL is not empty.
+        txn_db_options.write_policy = TxnDBWritePolicy::WRITE_UNPREPARED;
+    }
+
+    TransactionDB *txn_db = nullptr;
+    OptimisticTransactionDB *o_txn_db = nullptr;
+    DB *r_db = nullptr;
+    if (!relation_cfs) {
+        if (db->secondary) {
+            write_status(DB::OpenAsSecondary(options, db->db_path, string(opts.secondary_path), &r_db), status);
+            db->rdb.reset(r_db);
+        } else if (read_only) {
+            write_status(DB::OpenForReadOnly(options, db->db_path, &r_db), status);
+            db->rdb.reset(r_db);
+        } else if (opts.optimistic_transactions) {
+            write_status(OptimisticTransactionDB::Open(options, db->db_path, &o_txn_db), status);
+            db->odb.reset(o_txn_db);
+        } else {
+            write_status(
+                    TransactionDB::Open(options, txn_db_options, db->db_path, &txn_db),
+                    status);
+            db->db.reset(txn_db);
+        }
+        return db;
+    }
+
+    Status s;
+    ColumnFamilyOptions cf_options(options);
+    if (!opts.relation_cf_options.empty()) {
+        ConfigOptions config_options;
+        s = GetColumnFamilyOptionsFromString(config_options, ColumnFamilyOptions(options),
+                                             string(opts.relation_cf_options), &cf_options);
+        if (!s.ok()) {
+            write_status(s, status);
+            return nullptr;
+        }
+    }
+
+    // column families created with custom options have them persisted by RocksDB
+    DBOptions persisted_db_opts;
+    vector<ColumnFamilyDescriptor> persisted_cf_descs;
+    if (!is_new) {
+        ConfigOptions config_options;
+        config_options.ignore_unknown_options = true;
+        if (!LoadLatestOptions(config_options, db->db_path, &persisted_db_opts, &persisted_cf_descs).ok()) {
+            persisted_cf_descs.clear();
+        }
+    }
+
+    vector<ColumnFamilyDescriptor> cf_descs;
+    vector<uint64_t> rel_ids;
+    cf_descs.emplace_back(kDefaultColumnFamilyName, ColumnFamilyOptions(options));
+    cf_descs.emplace_back(RELATION_CFS_MARKER, ColumnFamilyOptions(options));
+    for (auto &name: existing_cfs) {
+        uint64_t rel_id;
+        if (!parse_relation_cf_name(name, rel_id)) {
+            continue;
+        }
+        ColumnFamilyOptions rel_options = cf_options;
+        for (auto &persisted: persisted_cf_descs) {
+            if (persisted.name == name) {
+                rel_options = persisted.options;
+                Options combined(DBOptions(options), rel_options);
+                rel_options.table_factory.reset(
+                        NewBlockBasedTableFactory(build_table_options(combined, opts, cache)));
+                rel_options.compaction_filter_factory = validity_retention;
+                // caches are not persisted
+                rel_options.blob_cache = blob_cache;
+                rel_options.prepopulate_blob_cache = options.prepopulate_blob_cache;
+                rel_options.merge_operator = options.merge_operator;
+                break;
+            }
+        }
+        cf_descs.emplace_back(name, rel_options);
+        rel_ids.push_back(rel_id);
+    }
+
+    vector<ColumnFamilyHandle *> handles;
+    if (db->secondary) {
+        s = DB::OpenAsSecondary(DBOptions(options), db->db_path, string(opts.secondary_path), cf_descs, &handles,
+                                &r_db);
+        db->rdb.reset(r_db);
+    } else if (read_only) {
+        s = DB::OpenForReadOnly(DBOptions(options), db->db_path, cf_descs, &handles, &r_db);
+        db->rdb.reset(r_db);
+    } else if (opts.optimistic_transactions) {
+        s = OptimisticTransactionDB::Open(DBOptions(options), db->db_path, cf_descs, &handles, &o_txn_db);
+        db->odb.reset(o_txn_db);
+    } else {
+        s = TransactionDB::Open(options, txn_db_options, db->db_path, cf_descs, &handles, &txn_db);
+        db->db.reset(txn_db);
+    }
+    write_status(s, status);
+    if (!s.ok()) {
+        return db;
+    }
+    auto opened_db = db->get_db();
+    // the default column family is reached through `DefaultColumnFamily()` instead
+    opened_db->DestroyColumnFamilyHandle(handles[0]);
+    opened_db->DestroyColumnFamilyHandle(handles[1]);
+    db->relation_cfs = make_unique<RelationColumnFamilies>(opened_db, cf_options);
+    for (size_t i = 0; i < rel_ids.size(); ++i) {
+        db->relation_cfs->add(rel_ids[i], handles[i + 2]);
+    }
+
 
     return db;
 }
 
+// Collects the records of write batches in a range of keys. Each record of a batch takes the
+// sequence number following the one of the record before it, starting from that of the batch.
+class ChangeCollector : public WriteBatch::Handler {
+    Slice lower;
+    Slice upper;
+    size_t limit;
+    uint64_t since;
+    rust::Vec<ChangeRecord> &changes;
+
+public:
+    uint64_t seq;
+    uint64_t next_seq;
+    bool full;
+
+    ChangeCollector(Slice lower_, Slice upper_, size_t limit_, uint64_t since_, rust::Vec<ChangeRecord> &changes_) :
+            lower(lower_), upper(upper_), limit(limit_), since(since_), changes(changes_), seq(since_),
+            next_seq(since_), full(false) {}
+
+    inline void collect(ChangeKind kind, const Slice &key, const Slice &value, bool in_range) {
+        auto cur = seq++;
+        if (cur < since) {
+            return;
+        }
+        if (in_range) {
+            if (changes.size() >= limit) {
+                full = true;
+                return;
+            }
+            changes.push_back(ChangeRecord{cur, kind, convert_slice_to_vec(key), convert_slice_to_vec(value)});
+        }
+        next_seq = cur + 1;
+    }
+
+    inline void skip() {
+        auto cur = seq++;
+        if (cur >= since && !full) {
+            next_seq = cur + 1;
+        }
+    }
+
+    [[nodiscard]] inline bool key_in_range(const Slice &key) const {
+        return key.compare(lower) >= 0 && key.compare(upper) < 0;
+    }
+
+    Status PutCF(uint32_t, const Slice &key, const Slice &value) override {
+        collect(ChangeKind::Put, key, value, key_in_range(key));
+        return Status::OK();
+    }
+
+    Status DeleteCF(uint32_t, const Slice &key) override {
+        collect(ChangeKind::Delete, key, Slice(), key_in_range(key));
+        return Status::OK();
+    }
+
+    Status SingleDeleteCF(uint32_t, const Slice &key) override {
+        collect(ChangeKind::Delete, key, Slice(), key_in_range(key));
+        return Status::OK();
+    }
+
+    Status DeleteRangeCF(uint32_t, const Slice &begin, const Slice &end) override {
+        collect(ChangeKind::DeleteRange, begin, end, begin.compare(upper) < 0 && end.compare(lower) > 0);
+        return Status::OK();
+    }
+
+    Status MergeCF(uint32_t, const Slice &key, const Slice &value) override {
+        collect(ChangeKind::Merge, key, value, key_in_range(key));
+        return Status::OK();
+    }
+
+    // values in the stacked blob DB format, not written by the integrated blob files
+    Status PutBlobIndexCF(uint32_t, const Slice &, const Slice &) override {
+        skip();
+        return Status::OK();
+    }
+
+    // the records below take no sequence number of their own with the write-committed policy;
+    // the default handlers fail the whole iteration
+    void LogData(const Slice &) override {}
+
+    Status MarkBeginPrepare(bool) override {
+        return Status::OK();
+    }
+
+    Status MarkEndPrepare(const Slice &) override {
+        return Status::OK();
+    }
+
+    Status MarkCommit(const Slice &) override {
+        return Status::OK();
+    }
+
+    Status MarkRollback(const Slice &) override {
+        return Status::OK();
+    }
+
+    Status MarkNoop(bool) override {
+        return Status::OK();
+    }
+
+    // the record the collector is full at is not taken, so that the next call starts from it
+    bool Continue() override {
+        return !full;
+    }
+};
+
+uint64_t RocksDbBridge::changes_since(uint64_t since, RustBytes lower, RustBytes upper, size_t limit,
+                                      rust::Vec<ChangeRecord> &changes, RocksDbStatus &status) const {
+    if (large_transactions) {
+        // the WAL holds data of transactions that may never commit, and counts sequence numbers per batch
+        write_status(large_transactions_error("changes cannot be read from the WAL"), status);
+        return since;
+    }
+    auto base_db = get_base_db();
+    auto latest = base_db->GetLatestSequenceNumber();
+    if (limit == 0) {
+        return latest + 1;
+    }
+    if (since > latest) {
+        return since;
+    }
+    unique_ptr<TransactionLogIterator> iter;
+    auto s = base_db->GetUpdatesSince(since, &iter);
+    if (!s.ok()) {
+        write_status(s, status);
+        return since;
+    }
+    ChangeCollector collector(convert_slice(lower), convert_slice(upper), limit, since, changes);
+    for (; iter->Valid() && !collector.full; iter->Next()) {
+        auto batch = iter->GetBatch();
+        // writes without the WAL and ingested files leave gaps in the sequence numbers
+        collector.seq = batch.sequence;
+        s = batch.writeBatchPtr->Iterate(&collector);
+        if (!s.ok()) {
+            write_status(s, status);
+            return collector.next_seq;
+        }
+    }
+    if (!collector.full) {
+        write_status(iter->status(), status);
+    }
+    return collector.next_seq;
+}
+
+rust::Vec<DbStat> RocksDbBridge::stats() const {
+    // summed over the column families
+    static const string CF_PROPERTIES[] = {
+            DB::Properties::kCurSizeActiveMemTable,
+            DB::Properties::kCurSizeAllMemTables,
+            DB::Properties::kSizeAllMemTables,
+            DB::Properties::kNumImmutableMemTable,
+            DB::Properties::kNumEntriesActiveMemTable,
+            DB::Properties::kNumEntriesImmMemTables,
+            DB::Properties::kEstimatePendingCompactionBytes,
+            DB::Properties::kCompactionPending,
+            DB::Properties::kMemTableFlushPending,
+            DB::Properties::kEstimateNumKeys,
+            DB::Properties::kEstimateLiveDataSize,
+            DB::Properties::kTotalSstFilesSize,
+            DB::Properties::kEstimateTableReadersMem,
+            DB::Properties::kNumBlobFiles,
+            DB::Properties::kTotalBlobFileSize,
+            DB::Properties::kLiveBlobFileSize,
+            DB::Properties::kLiveBlobFileGarbageSize,
+    };
+    // the same for all column families
+    static const string DB_PROPERTIES[] = {
+            DB::Properties::kNumRunningCompactions,
+            DB::Properties::kNumRunningFlushes,
+            DB::Properties::kIsWriteStopped,
+            DB::Properties::kActualDelayedWriteRate,
+            DB::Properties::kNumSnapshots,
+            DB::Properties::kBackgroundErrors,
+            DB::Properties::kBlockCacheCapacity,
+            DB::Properties::kBlockCacheUsage,
+            DB::Properties::kBlockCachePinnedUsage,
+            DB::Properties::kBlobCacheCapacity,
+            DB::Properties::kBlobCacheUsage,
+            DB::Properties::kBlobCachePinnedUsage,
+    };
+    static const string STALL_PREFIX = "io_stalls.";
+
+    auto base_db = get_base_db();
+    auto cfs = relation_cfs == nullptr ? vector<ColumnFamilyHandle *>{base_db->DefaultColumnFamily()}
+                                       : relation_cfs->all();
+    rust::Vec<DbStat> ret;
+    auto push = [&](const string &name, uint64_t value) {
+        ret.push_back(DbStat{rust::String(name), value});
+    };
+    uint64_t value;
+    for (auto &prop: CF_PROPERTIES) {
+        uint64_t total = 0;
+        for (auto cf: cfs) {
+            if (base_db->GetIntProperty(cf, prop, &value)) {
+                total += value;
+            }
+        }
+        push(prop, total);
+    }
+    for (auto &prop: DB_PROPERTIES) {
+        if (base_db->GetIntProperty(prop, &value)) {
+            push(prop, value);
+        }
+    }
+
+    vector<uint64_t> files_at_level;
+    map<string, uint64_t> stalls;
+    for (auto cf: cfs) {
+        auto levels = static_cast<size_t>(base_db->NumberLevels(cf));
+        if (files_at_level.size() < levels) {
+            files_at_level.resize(levels);
+        }
+        string files;
+        for (size_t level = 0; level < levels; ++level) {
+            if (base_db->GetProperty(cf, DB::Properties::kNumFilesAtLevelPrefix + to_string(level), &files)) {
+                files_at_level[level] += strtoull(files.c_str(), nullptr, 10);
+            }
+        }
+        map<string, string> cf_stats;
+        if (base_db->GetMapProperty(cf, DB::Properties::kCFStats, &cf_stats)) {
+            for (auto &kv: cf_stats) {
+                if (kv.first.compare(0, STALL_PREFIX.size(), STALL_PREFIX) == 0) {
+                    stalls[kv.first] += strtoull(kv.second.c_str(), nullptr, 10);
+                }
+            }
+        }
+    }
+    for (size_t level = 0; level < files_at_level.size(); ++level) {
+        push(DB::Properties::kNumFilesAtLevelPrefix + to_string(level), files_at_level[level]);
+    }
+    for (auto &kv: stalls) {
+        push(DB::Properties::kCFStats + "." + kv.first, kv.second);
+    }
+
+    if (secondary_cache != nullptr) {
+        size_t size;
+        if (secondary_cache->GetCapacity(size).ok()) {
+            push("rocksdb.secondary-cache-capacity", size);
+        }
+        if (secondary_cache->GetUsage(size).ok()) {
+            push("rocksdb.secondary-cache-usage", size);
+        }
+    }
+
+    if (statistics != nullptr) {
+        for (auto &ticker: TickersNameMap) {
+            push(ticker.second, statistics->getTickerCount(ticker.first));
+        }
+    }
+    return ret;
+}
+
+void RocksDbBridge::checkpoint(rust::Str dir, RocksDbStatus &status) const {
+    Checkpoint *checkpoint_ptr = nullptr;
+    auto s = Checkpoint::Create(get_base_db(), &checkpoint_ptr);
+    if (!s.ok()) {
+        write_status(s, status);
+        return;
+    }
+    unique_ptr<Checkpoint> checkpoint(checkpoint_ptr);
+    write_status(checkpoint->CreateCheckpoint(string(dir)), status);
+}
+
+void RocksDbBridge::create_backup(rust::Str backup_dir, uint32_t max_backups, RocksDbStatus &status) const {
+    BackupEngine *engine_ptr = nullptr;
+    auto s = BackupEngine::Open(BackupEngineOptions(string(backup_dir)), Env::Default(), &engine_ptr);
+    if (!s.ok()) {
+        write_status(s, status);
+        return;
+    }
+    unique_ptr<BackupEngine> engine(engine_ptr);
+    // the live WAL files are backed up as well, so there is no need to flush first
+    s = engine->CreateNewBackup(get_base_db(), false);
+    if (s.ok() && max_backups > 0) {
+        s = engine->PurgeOldBackups(max_backups);
+    }
+    write_status(s, status);
+}
+
+rust::Vec<SplitKey> RocksDbBridge::split_range(RustBytes start, RustBytes end, size_t n) const {
+    // estimating sizes costs an index lookup per candidate, so there is no point in having many more than needed
+    static const size_t CANDIDATES_PER_PART = 16;
+
+    rust::Vec<SplitKey> ret;
+    auto start_ = convert_slice(start);
+    auto end_ = convert_slice(end);
+    if (n < 2 || start_.compare(end_) >= 0) {
+        return ret;
+    }
+    vector<LiveFileMetaData> files;
+    get_base_db()->GetLiveFilesMetaData(&files);
+    vector<string> candidates;
+    for (auto &file: files) {
+        for (auto key: {&file.smallestkey, &file.largestkey}) {
+            Slice key_(*key);
+            if (key_.compare(start_) > 0 && key_.compare(end_) < 0) {
+                candidates.push_back(*key);
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    if (candidates.size() > n * CANDIDATES_PER_PART) {
+        vector<string> sampled;
+        auto step = static_cast<double>(candidates.size()) / static_cast<double>(n * CANDIDATES_PER_PART);
+        for (size_t i = 0; i < n * CANDIDATES_PER_PART; ++i) {
+            sampled.push_back(std::move(candidates[static_cast<size_t>(i * step)]));
+        }
+        candidates = std::move(sampled);
+    }
+    if (candidates.empty()) {
+        return ret;
+    }
+
+    // the sizes of `[start, candidate)` for each candidate, then of the whole range
+    vector<Range> ranges;
+    ranges.reserve(candidates.size() + 1);
+    for (auto &candidate: candidates) {
+        ranges.emplace_back(start_, candidate);
+    }
+    ranges.emplace_back(start_, end_);
+    vector<uint64_t> sizes(ranges.size(), 0);
+    vector<uint64_t> cf_sizes(ranges.size(), 0);
+    SizeApproximationOptions options;
+    options.include_memtables = true;
+    options.include_files = true;
+    for (auto cf: range_cfs(ranges.back())) {
+        if (get_base_db()->GetApproximateSizes(options, cf, ranges.data(), static_cast<int>(ranges.size()),
+                                               cf_sizes.data()).ok()) {
+            for (size_t i = 0; i < sizes.size(); ++i) {
+                sizes[i] += cf_sizes[i];
+            }
+        }
+    }
+    auto total = sizes.back();
+    if (total == 0) {
+        return ret;
+    }
+
+    // the first candidate reaching each of `total * k / n`
+    size_t k = 1;
+    for (size_t i = 0; i < candidates.size() && k < n; ++i) {
+        if (sizes[i] * n < total * k) {
+            continue;
+        }
+        while (k < n && sizes[i] * n >= total * k) {
+            ++k;
+        }
+        if (sizes[i] < total) {
+            SplitKey split;
+            split.key.reserve(candidates[i].size());
+            for (auto c: candidates[i]) {
+                split.key.push_back(static_cast<uint8_t>(c));
+            }
+            ret.push_back(std::move(split));
+        }
+    }
+    return ret;
+}
+
+void restore_from_backup(rust::Str backup_dir, rust::Str db_dir, RocksDbStatus &status) {
+    BackupEngineReadOnly *engine_ptr = nullptr;
+    auto s = BackupEngineReadOnly::Open(BackupEngineOptions(string(backup_dir)), Env::Default(), &engine_ptr);
+    if (!s.ok()) {
+        write_status(s, status);
+        return;
+    }
+    unique_ptr<BackupEngineReadOnly> engine(engine_ptr);
+    string dir(db_dir);
+    write_status(engine->RestoreDBFromLatestBackup(dir, dir), status);
+}
+
 RocksDbBridge::~RocksDbBridge() {
-    if (destroy_on_exit && (db != nullptr)) {
+    relation_cfs.reset();
+    if (destroy_on_exit && (db != nullptr || odb != nullptr)) {
         cerr << "destroying database on exit: " << db_path << endl;
-        auto status = db->Close();
+        auto status = get_db()->Close();
         if (!status.ok()) {
             cerr << status.ToString() << endl;
         }
         db.reset();
+        odb.reset();
         Options options{};
         auto status2 = DestroyDB(db_path, options);
         if (!status2.ok()) {
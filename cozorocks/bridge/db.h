@@ -7,24 +7,18 @@
 #ifndef COZOROCKS_DB_H
 #define COZOROCKS_DB_H
 
+#include <atomic>
 #include <utility>
 
 #include "iostream"
 #include "common.h"
+#include "rocksdb/sst_file_reader.h"
+#include "rocksdb/listener.h"
+#include "rocksdb/secondary_cache.h"
 #include "tx.h"
 #include "slice.h"
-
-struct SnapshotBridge {
-    const Snapshot *snapshot;
-    DB *db;
-
-    explicit SnapshotBridge(const Snapshot *snapshot_, DB *db_) : snapshot(snapshot_), db(db_) {}
-
-    ~SnapshotBridge() {
-        db->ReleaseSnapshot(snapshot);
-//        printf("released snapshot\n");
-    }
-};
+#include "cf.h"
+#include "ttl.h"
 
 struct SstFileWriterBridge {
     SstFileWriter inner;
@@ -44,15 +38,129 @@ struct SstFileWriterBridge {
 
 static WriteOptions DEFAULT_WRITE_OPTIONS = WriteOptions();
 
+struct WriteBatchBridge {
+    DB *db;
+    // null unless there is a column family per relation
+    RelationColumnFamilies *cfs;
+    WriteBatch batch;
+    WriteOptions w_opts;
+    // number of operations buffered before they are written out, 0 means only on `flush`
+    size_t batch_size;
+
+    explicit WriteBatchBridge(DB *db_, RelationColumnFamilies *cfs_, size_t batch_size_) :
+            db(db_), cfs(cfs_), batch(), w_opts(), batch_size(batch_size_) {}
+
+    inline WriteOptions &get_w_opts() {
+        return w_opts;
+    }
+
+    inline ColumnFamilyHandle *cf_for_write(const Slice &key, Status &status) const {
+        if (cfs == nullptr) {
+            return db->DefaultColumnFamily();
+        }
+        return cfs->for_write(key, status);
+    }
+
+    inline void put(RustBytes key, RustBytes val, RocksDbStatus &status) {
+        auto key_ = convert_slice(key);
+        Status s;
+        auto cf = cf_for_write(key_, s);
+        if (s.ok()) {
+            s = batch.Put(cf, key_, convert_slice(val));
+        }
+        if (!s.ok()) {
+            write_status(s, status);
+            return;
+        }
+        maybe_flush(status);
+    }
+
+    inline void del(RustBytes key, RocksDbStatus &status) {
+        auto key_ = convert_slice(key);
+        Status s;
+        auto cf = cf_for_write(key_, s);
+        if (s.ok()) {
+            s = batch.Delete(cf, key_);
+        }
+        if (!s.ok()) {
+            write_status(s, status);
+            return;
+        }
+        maybe_flush(status);
+    }
+
+    inline void maybe_flush(RocksDbStatus &status) {
+        if (batch_size > 0 && batch.Count() >= batch_size) {
+            flush(status);
+        } else {
+            write_status(Status::OK(), status);
+        }
+    }
+
+    inline void flush(RocksDbStatus &status) {
+        if (batch.Count() == 0) {
+            write_status(Status::OK(), status);
+            return;
+        }
+        auto s = db->Write(w_opts, &batch);
+        batch.Clear();
+        write_status(s, status);
+    }
+
+    [[nodiscard]] inline size_t pending() const {
+        return batch.Count();
+    }
+};
+
+// Keeps track of the worst write stall condition over all column families:
+// 0 when writes proceed normally, 1 when they are slowed down and 2 when they are stopped
+struct WriteStallListener : public EventListener {
+    std::mutex mutex;
+    unordered_map<string, WriteStallCondition> conditions;
+    std::atomic<uint8_t> state{0};
+
+    void OnStallConditionsChanged(const WriteStallInfo &info) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (info.condition.cur == WriteStallCondition::kNormal) {
+            conditions.erase(info.cf_name);
+        } else {
+            conditions[info.cf_name] = info.condition.cur;
+        }
+        uint8_t worst = 0;
+        for (auto &kv: conditions) {
+            worst = std::max(worst, static_cast<uint8_t>(kv.second == WriteStallCondition::kStopped ? 2 : 1));
+        }
+        state.store(worst, std::memory_order_relaxed);
+    }
+};
+
 struct RocksDbBridge {
+    // exactly one of `db` and `odb` is set, depending on whether transactions are optimistic,
+    // unless the database is opened read-only or as a secondary, in which case only `rdb` is set
     unique_ptr<TransactionDB> db;
+    unique_ptr<OptimisticTransactionDB> odb;
+    unique_ptr<DB> rdb;
+    // declared after the databases so that the handles are released before the databases are
+    unique_ptr<RelationColumnFamilies> relation_cfs;
+    shared_ptr<Cache> block_cache;
+    shared_ptr<Cache> blob_cache;
+    // only set if the block cache has a secondary cache
+    shared_ptr<SecondaryCache> secondary_cache;
+    // only set if statistics are enabled
+    shared_ptr<Statistics> statistics;
+    shared_ptr<WriteStallListener> stall_listener;
+    shared_ptr<ValidityRetentionFilterFactory> validity_retention;
 
     bool destroy_on_exit;
+    bool secondary;
+    // cap in bytes on the writes buffered by a pessimistic transaction, 0 for none
+    size_t tx_write_buffer_limit;
+    bool large_transactions;
     string db_path;
 
     inline unique_ptr<SstFileWriterBridge> get_sst_writer(rust::Str path, RocksDbStatus &status) const {
         DB *db_ = get_base_db();
-        auto cf = db->DefaultColumnFamily();
+        auto cf = db_->DefaultColumnFamily();
         Options options_ = db_->GetOptions(cf);
         auto sst_file_writer = std::make_unique<SstFileWriterBridge>(EnvOptions(), options_);
         string path_(path);
@@ -62,32 +170,160 @@ struct RocksDbBridge {
     }
 
     inline void ingest_sst(rust::Str path, RocksDbStatus &status) const {
+        if (large_transactions) {
+            write_status(large_transactions_error("SST files cannot be ingested"), status);
+            return;
+        }
         IngestExternalFileOptions ifo;
         DB *db_ = get_base_db();
         string path_(path);
-        auto cf = db->DefaultColumnFamily();
+        auto cf = db_->DefaultColumnFamily();
         write_status(db_->IngestExternalFile(cf, {std::move(path_)}, ifo), status);
     }
 
+    // Ingests all the files atomically in a single call. Files must not overlap with each other,
+    // and with column families per relation each file must only hold keys of a single relation.
+    inline void ingest_sst_files(rust::Slice<const rust::String> paths, bool move_files, bool allow_global_seqno,
+                                 RocksDbStatus &status) const {
+        if (large_transactions) {
+            write_status(large_transactions_error("SST files cannot be ingested"), status);
+            return;
+        }
+        IngestExternalFileOptions ifo;
+        ifo.move_files = move_files;
+        ifo.allow_global_seqno = allow_global_seqno;
+        DB *db_ = get_base_db();
+        if (relation_cfs == nullptr) {
+            vector<string> files;
+            files.reserve(paths.size());
+            for (auto &path: paths) {
+                files.emplace_back(path);
+            }
+            write_status(db_->IngestExternalFile(db_->DefaultColumnFamily(), files, ifo), status);
+            return;
+        }
+        vector<IngestExternalFileArg> args;
+        unordered_map<ColumnFamilyHandle *, size_t> arg_idx;
+        for (auto &path: paths) {
+            string path_(path);
+            Status s;
+            auto cf = cf_of_sst(path_, s);
+            if (!s.ok()) {
+                write_status(s, status);
+                return;
+            }
+            auto found = arg_idx.find(cf);
+            if (found == arg_idx.end()) {
+                found = arg_idx.emplace(cf, args.size()).first;
+                args.emplace_back();
+                args.back().column_family = cf;
+                args.back().options = ifo;
+            }
+            args[found->second].external_files.push_back(std::move(path_));
+        }
+        write_status(db_->IngestExternalFiles(args), status);
+    }
+
+    // The column family the keys of an SST file belong to, judging from its first key
+    inline ColumnFamilyHandle *cf_of_sst(const string &path, Status &status) const {
+        DB *db_ = get_base_db();
+        SstFileReader reader(db_->GetOptions());
+        status = reader.Open(path);
+        if (!status.ok()) {
+            return nullptr;
+        }
+        unique_ptr<Iterator> it(reader.NewIterator(ReadOptions()));
+        it->SeekToFirst();
+        if (!it->Valid()) {
+            status = it->status();
+            return db_->DefaultColumnFamily();
+        }
+        return relation_cfs->for_write(it->key(), status);
+    }
+
     [[nodiscard]] inline const string &get_db_path() const {
         return db_path;
     }
 
 
     [[nodiscard]] inline unique_ptr<TxBridge> transact() const {
-        auto ret = make_unique<TxBridge>(&*this->db, db->DefaultColumnFamily());
+        if (odb != nullptr) {
+            return make_unique<TxBridge>(&*this->odb, odb->DefaultColumnFamily(), relation_cfs.get());
+        }
+        if (rdb != nullptr) {
+            return make_unique<TxBridge>(rdb.get(), rdb->DefaultColumnFamily(), relation_cfs.get());
+        }
+        auto ret = make_unique<TxBridge>(&*this->db, db->DefaultColumnFamily(), relation_cfs.get());
+        ret->write_unprepared = large_transactions;
+        if (tx_write_buffer_limit > 0) {
+            if (large_transactions) {
+                // written to the database as unprepared data past this, and removed again on rollback
+                ret->p_tx_opts->write_batch_flush_threshold = static_cast<int64_t>(tx_write_buffer_limit);
+            } else {
+                // writes past this fail with a memory limit status
+                ret->p_tx_opts->max_write_batch_size = tx_write_buffer_limit;
+            }
+        }
+        return ret;
+    }
+
+    // A transaction that can only read, from a snapshot of the base database taken now
+    [[nodiscard]] inline unique_ptr<TxBridge> transact_read_only() const {
+        auto ret = transact();
+        ret->start_read_only();
         return ret;
     }
 
+    [[nodiscard]] inline bool uses_relation_cfs() const {
+        return relation_cfs != nullptr;
+    }
+
+    // Creates the column family for the relation with custom options given in the RocksDB
+    // options string format, e.g. "compaction_style=kCompactionStyleUniversal;enable_blob_files=true".
+    // Without calling this, a column family with the default options is created on the first write.
+    inline void create_relation_cf(uint64_t rel_id, rust::Str cf_options, RocksDbStatus &status) const {
+        if (relation_cfs == nullptr) {
+            write_status(Status::NotSupported("column families per relation are not enabled"), status);
+            return;
+        }
+        ColumnFamilyOptions options;
+        ConfigOptions config_options;
+        config_options.ignore_unknown_options = false;
+        auto s = GetColumnFamilyOptionsFromString(config_options, relation_cfs->cf_options, string(cf_options),
+                                                  &options);
+        if (!s.ok()) {
+            write_status(s, status);
+            return;
+        }
+        relation_cfs->create(rel_id, options, s);
+        write_status(s, status);
+    }
+
+    [[nodiscard]] inline ColumnFamilyHandle *cf_for(const Slice &key) const {
+        if (relation_cfs == nullptr) {
+            return get_base_db()->DefaultColumnFamily();
+        }
+        return relation_cfs->for_key(key);
+    }
+
     inline void del_range(RustBytes start, RustBytes end, RocksDbStatus &status) const {
+        if (large_transactions) {
+            write_status(large_transactions_error("ranges cannot be deleted"), status);
+            return;
+        }
         WriteBatch batch;
-        auto cf = db->DefaultColumnFamily();
-        auto s = batch.DeleteRange(cf, convert_slice(start), convert_slice(end));
+        auto start_s = convert_slice(start);
+        auto cf = cf_for(start_s);
+        auto s = batch.DeleteRange(cf, start_s, convert_slice(end));
         if (!s.ok()) {
             write_status(s, status);
             return;
         }
         WriteOptions w_opts;
+        if (db == nullptr) {
+            write_status(get_base_db()->Write(w_opts, &batch), status);
+            return;
+        }
         TransactionDBWriteOptimizations optimizations;
         optimizations.skip_concurrency_control = true;
         optimizations.skip_duplicate_key_check = true;
@@ -96,28 +332,189 @@ struct RocksDbBridge {
     }
 
     inline void put(RustBytes key, RustBytes val, RocksDbStatus &status) const {
-        auto raw_db = this->get_base_db();
+        auto raw_db = get_write_db();
         auto s = raw_db->Put(DEFAULT_WRITE_OPTIONS, convert_slice(key), convert_slice(val));
         write_status(s, status);
     }
 
+    [[nodiscard]] inline unique_ptr<WriteBatchBridge> write_batch(size_t batch_size) const {
+        return make_unique<WriteBatchBridge>(get_write_db(), relation_cfs.get(), batch_size);
+    }
+
     void compact_range(RustBytes start, RustBytes end, RocksDbStatus &status) const {
         CompactRangeOptions options;
-        auto cf = db->DefaultColumnFamily();
         auto start_s = convert_slice(start);
         auto end_s = convert_slice(end);
-        auto s = db->CompactRange(options, cf, &start_s, &end_s);
-        write_status(s, status);
+        auto db_ = get_base_db();
+        if (relation_cfs == nullptr) {
+            auto s = db_->CompactRange(options, db_->DefaultColumnFamily(), &start_s, &end_s);
+            write_status(s, status);
+            return;
+        }
+        for (auto cf: relation_cfs->all()) {
+            auto s = db_->CompactRange(options, cf, &start_s, &end_s);
+            if (!s.ok()) {
+                write_status(s, status);
+                return;
+            }
+        }
+        write_status(Status::OK(), status);
+    }
+
+    // Estimated size in bytes taken by the keys in `[start, end)`, from the SST files and optionally the memtables.
+    // This does not read any data and is cheap enough to call before planning a scan.
+    [[nodiscard]] inline uint64_t approximate_size(RustBytes start, RustBytes end, bool include_memtables) const {
+        Range range(convert_slice(start), convert_slice(end));
+        SizeApproximationOptions options;
+        options.include_memtables = include_memtables;
+        options.include_files = true;
+        uint64_t total = 0;
+        for (auto cf: range_cfs(range)) {
+            uint64_t size = 0;
+            if (get_base_db()->GetApproximateSizes(options, cf, &range, 1, &size).ok()) {
+                total += size;
+            }
+        }
+        return total;
     }
 
-    DB *get_base_db() const {
+    // Estimated number of entries and their size in bytes for the keys in `[start, end)` that are still in the memtables
+    inline void approximate_memtable_stats(RustBytes start, RustBytes end, uint64_t &count, uint64_t &size) const {
+        Range range(convert_slice(start), convert_slice(end));
+        count = 0;
+        size = 0;
+        for (auto cf: range_cfs(range)) {
+            uint64_t cf_count = 0;
+            uint64_t cf_size = 0;
+            get_base_db()->GetApproximateMemTableStats(cf, range, &cf_count, &cf_size);
+            count += cf_count;
+            size += cf_size;
+        }
+    }
+
+    // At most `n - 1` keys inside `(start, end)`, ascending, that split it into parts of about the same size,
+    // for scanning the parts concurrently. The keys are taken from the boundaries of the SST files.
+    [[nodiscard]] rust::Vec<SplitKey> split_range(RustBytes start, RustBytes end, size_t n) const;
+
+    // The writes to keys in `[lower, upper)` with sequence numbers from `since` on, read from the WAL, at most
+    // `limit` of them. Returns the sequence number to continue from. With a `limit` of 0, nothing is read
+    // and the sequence number following the latest write is returned.
+    uint64_t changes_since(uint64_t since, RustBytes lower, RustBytes upper, size_t limit,
+                           rust::Vec<ChangeRecord> &changes, RocksDbStatus &status) const;
+
+    // Opens the table readers of the SST files holding keys in `[start, end)`, which loads their index and
+    // filter blocks into the block cache, so that the first reads of the range after opening do not wait for it
+    inline void warm_up(RustBytes start, RustBytes end, RocksDbStatus &status) const {
+        auto start_s = convert_slice(start);
+        auto end_s = convert_slice(end);
+        Range range(start_s, end_s);
+        for (auto cf: range_cfs(range)) {
+            TablePropertiesCollection props;
+            auto s = get_base_db()->GetPropertiesOfTablesInRange(cf, &range, 1, &props);
+            if (!s.ok()) {
+                write_status(s, status);
+                return;
+            }
+        }
+    }
+
+    // Memtable, compaction, write stall and block cache properties, file counts per level and,
+    // with statistics enabled, all ticker counts. Properties are summed over the column families.
+    [[nodiscard]] rust::Vec<DbStat> stats() const;
+
+    // Writes a consistent copy of the database into the directory `dir`, which must not exist yet.
+    // SST files are hard-linked when `dir` is on the same file system, so this takes seconds.
+    void checkpoint(rust::Str dir, RocksDbStatus &status) const;
+
+    // Adds a backup to the backup directory `backup_dir`, only copying the SST files that earlier
+    // backups there do not have already. Keeps the latest `max_backups` backups if it is not 0.
+    void create_backup(rust::Str backup_dir, uint32_t max_backups, RocksDbStatus &status) const;
+
+    // See `WriteStallListener`. Write transactions started while writes are stopped
+    // block on commit, unless started with `no_slowdown`, in which case they fail.
+    [[nodiscard]] inline uint8_t write_stall_state() const {
+        return stall_listener->state.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] inline vector<ColumnFamilyHandle *> range_cfs(const Range &range) const {
+        if (relation_cfs == nullptr) {
+            return {get_base_db()->DefaultColumnFamily()};
+        }
+        return relation_cfs->handles_in_range(range.start, range.limit);
+    }
+
+    [[nodiscard]] inline bool is_optimistic() const {
+        return odb != nullptr;
+    }
+
+    [[nodiscard]] inline bool is_read_only() const {
+        return rdb != nullptr;
+    }
+
+    // the transaction database, as opposed to the base database underneath it
+    [[nodiscard]] DB *get_db() const {
+        if (odb != nullptr) {
+            return &*odb;
+        }
+        if (rdb != nullptr) {
+            return rdb.get();
+        }
+        return &*db;
+    }
+
+    // The database to write to outside of transactions. Write-unprepared transactions keep a record
+    // of which sequence numbers are committed, which writes to the base database would go around.
+    [[nodiscard]] inline DB *get_write_db() const {
+        if (large_transactions && db != nullptr) {
+            return db.get();
+        }
+        return get_base_db();
+    }
+
+    // With write-unprepared transactions, sequence numbers are taken per batch instead of per key,
+    // and only the transaction database knows which writes are committed: nothing that writes
+    // around it or reads the WAL directly is supported
+    [[nodiscard]] static inline Status large_transactions_error(const string &what) {
+        return Status::NotSupported(what + " in databases opened with large transactions");
+    }
+
+    [[nodiscard]] DB *get_base_db() const {
+        if (odb != nullptr) {
+            return odb->GetBaseDB();
+        }
+        if (rdb != nullptr) {
+            return rdb.get();
+        }
         return db->GetBaseDB();
     }
 
+    // From the next compactions on, drop the versions of the rows of the time travel relation `rel_id`
+    // that are older than `retention_micros` and no longer current, or even if current with `expire_current`
+    inline void set_validity_retention(uint64_t rel_id, int64_t retention_micros, bool expire_current) const {
+        validity_retention->set(rel_id, ValidityRetention{retention_micros, expire_current});
+    }
+
+    inline void clear_validity_retention(uint64_t rel_id) const {
+        validity_retention->clear(rel_id);
+    }
+
+    // Makes the writes of the primary so far visible to a secondary instance. Column families
+    // created by the primary since the secondary opened only become visible when it reopens.
+    inline void catch_up_with_primary(RocksDbStatus &status) const {
+        if (!secondary) {
+            write_status(Status::NotSupported("the database is not opened as a secondary"), status);
+            return;
+        }
+        write_status(rdb->TryCatchUpWithPrimary(), status);
+    }
+
     ~RocksDbBridge();
 };
 
 shared_ptr<RocksDbBridge>
 open_db(const DbOpts &opts, RocksDbStatus &status);
 
+// Restores the latest backup in `backup_dir` into `db_dir`, which must not be in use
+void restore_from_backup(rust::Str backup_dir, rust::Str db_dir, RocksDbStatus &status);
+
 #endif //COZOROCKS_DB_H
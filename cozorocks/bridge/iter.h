@@ -7,27 +7,60 @@
 #ifndef COZOROCKS_ITER_H
 #define COZOROCKS_ITER_H
 
+#include <mutex>
 #include "common.h"
 #include "slice.h"
 #include "status.h"
+#include "cf.h"
+#include "perf.h"
 
 struct IterBridge {
     DB *db;
     Transaction *tx;
+    const RelationColumnFamilies *cfs;
     unique_ptr<Iterator> iter;
     string lower_storage;
     string upper_storage;
     Slice lower_bound;
     Slice upper_bound;
     unique_ptr<ReadOptions> r_opts;
+    string batch;
+    // what `iter` was created with, to tell whether `retarget` can keep it
+    ColumnFamilyHandle *iter_cf;
+    bool iter_bounded;
+    // set by `use_long_scan_reads`, with the options it replaced
+    bool long_scan;
+    unique_ptr<ReadOptions> short_scan_opts;
+    // owned by the transaction, only set when it collects perf stats
+    PerfStats *perf;
+    // owned by the transaction, only set for write-unprepared transactions, which keep a list of
+    // their live iterators that is not synchronized: creating and destroying their iterators from
+    // several threads at once must be serialized
+    std::mutex *tx_iters_mutex;
 
-    explicit IterBridge(Transaction *tx_) : db(nullptr), tx(tx_), iter(nullptr), lower_bound(),
+    explicit IterBridge(Transaction *tx_, const RelationColumnFamilies *cfs_) : db(nullptr), tx(tx_), cfs(cfs_),
+                                                                                iter(nullptr), lower_bound(),
                                                                      upper_bound(),
-                                                                     r_opts(new ReadOptions) {
-        r_opts->ignore_range_deletions = true;
+                                                                     r_opts(new ReadOptions),
+                                                                     batch(), iter_cf(nullptr),
+                                                                     iter_bounded(false), long_scan(false),
+                                                                     short_scan_opts(), perf(nullptr),
+                                                                     tx_iters_mutex(nullptr) {
         r_opts->auto_prefix_mode = true;
     }
 
+    ~IterBridge() {
+        auto guard = lock_tx_iters();
+        iter.reset();
+    }
+
+    [[nodiscard]] inline unique_lock<std::mutex> lock_tx_iters() const {
+        if (tx_iters_mutex == nullptr) {
+            return {};
+        }
+        return unique_lock<std::mutex>(*tx_iters_mutex);
+    }
+
     inline void set_snapshot(const Snapshot *snapshot) {
         r_opts->snapshot = snapshot;
     }
@@ -64,6 +97,37 @@ struct IterBridge {
         r_opts->pin_data = val;
     }
 
+    inline void async_io(bool val) {
+        r_opts->async_io = val;
+    }
+
+    inline void adaptive_readahead(bool val) {
+        r_opts->adaptive_readahead = val;
+    }
+
+    inline void readahead_size(size_t val) {
+        r_opts->readahead_size = val;
+    }
+
+    // Switches a started iterator to reads suited to long scans: blocks are prefetched ahead
+    // of the iterator, asynchronously with `async_io_`. Read options only apply to new RocksDB
+    // iterators, so the iterator is recreated at the same position.
+    inline void use_long_scan_reads(bool async_io_, size_t readahead_size_) {
+        if (long_scan) {
+            return;
+        }
+        long_scan = true;
+        short_scan_opts = make_unique<ReadOptions>(*r_opts);
+        r_opts->adaptive_readahead = true;
+        r_opts->async_io = async_io_;
+        r_opts->readahead_size = readahead_size_;
+        if (iter && iter->Valid()) {
+            string current = iter->key().ToString();
+            start();
+            iter->Seek(current);
+        }
+    }
+
     inline void clear_bounds() {
         r_opts->iterate_lower_bound = nullptr;
         r_opts->iterate_upper_bound = nullptr;
@@ -83,32 +147,74 @@ struct IterBridge {
         r_opts->iterate_upper_bound = &upper_bound;
     }
 
+    // With column families per relation, the iterator reads the column family of the relation
+    // its lower bound belongs to, and must not be used to cross into another relation.
     inline void start() {
-        if (db == nullptr) {
+        auto guard = lock_tx_iters();
+        iter_bounded = r_opts->iterate_lower_bound != nullptr && r_opts->iterate_upper_bound != nullptr;
+        iter_cf = nullptr;
+        if (cfs != nullptr) {
+            auto cf = cfs->for_key(lower_bound);
+            iter_cf = cf;
+            if (db == nullptr) {
+                iter.reset(tx->GetIterator(*r_opts, cf));
+            } else {
+                iter.reset(db->NewIterator(*r_opts, cf));
+            }
+        } else if (db == nullptr) {
             iter.reset(tx->GetIterator(*r_opts));
         } else {
             iter.reset(db->NewIterator(*r_opts));
         }
     }
 
+    // Points a started iterator at new bounds and seeks to the lower one. RocksDB iterators read
+    // their bounds through `r_opts` on every seek, so the underlying iterator is kept unless it has
+    // been created without bounds or reads the column family of another relation.
+    inline void retarget(RustBytes lower, RustBytes upper) {
+        set_lower_bound(lower);
+        set_upper_bound(upper);
+        bool restart = !iter || !iter_bounded || (cfs != nullptr && cfs->for_key(lower_bound) != iter_cf);
+        if (long_scan) {
+            // the next scan may well be short
+            r_opts->adaptive_readahead = short_scan_opts->adaptive_readahead;
+            r_opts->async_io = short_scan_opts->async_io;
+            r_opts->readahead_size = short_scan_opts->readahead_size;
+            long_scan = false;
+            restart = true;
+        }
+        PerfScope scope(perf, "iter.seek");
+        if (restart) {
+            start();
+        }
+        iter->Seek(lower_bound);
+    }
+
     inline void reset() {
-        iter.reset();
+        {
+            auto guard = lock_tx_iters();
+            iter.reset();
+        }
         clear_bounds();
     }
 
     inline void to_start() {
+        PerfScope scope(perf, "iter.seek");
         iter->SeekToFirst();
     }
 
     inline void to_end() {
+        PerfScope scope(perf, "iter.seek");
         iter->SeekToLast();
     }
 
     inline void seek(RustBytes key) {
+        PerfScope scope(perf, "iter.seek");
         iter->Seek(convert_slice(key));
     }
 
     inline void seek_backward(RustBytes key) {
+        PerfScope scope(perf, "iter.seek");
         iter->SeekForPrev(convert_slice(key));
     }
 
@@ -117,13 +223,107 @@ struct IterBridge {
     }
 
     inline void next() {
+        PerfScope scope(perf, "iter.next");
         iter->Next();
     }
 
     inline void prev() {
+        PerfScope scope(perf, "iter.next");
         iter->Prev();
     }
 
+    // Copies up to `n` entries starting from the current position into a buffer owned by the iterator and
+    // moves past them. Each entry is laid out as a native-endian u32 key length, the key, a u32 value
+    // length and the value. Stops early at the upper bound, or once the entries exceed `max_bytes`,
+    // but always includes at least one entry if there is any. An empty result means the end has been
+    // reached. The result stays valid until the next call.
+    inline RustBytes next_batch(size_t n, size_t max_bytes, RocksDbStatus &status) {
+        PerfScope scope(perf, "iter.next_batch");
+        batch.clear();
+        for (size_t i = 0; i < n && iter->Valid(); ++i) {
+            auto k = iter->key();
+            if (r_opts->iterate_upper_bound != nullptr && k.compare(upper_bound) >= 0) {
+                break;
+            }
+            auto v = iter->value();
+            if (i > 0 && batch.size() + 2 * sizeof(uint32_t) + k.size() + v.size() > max_bytes) {
+                break;
+            }
+            append_batch_entry_part(k);
+            append_batch_entry_part(v);
+            iter->Next();
+        }
+        write_status(iter->status(), status);
+        return convert_slice_back(batch);
+    }
+
+    // Skip scan over keys ending with a fixed-size suffix of `suffix_len` bytes (the validity of a
+    // time-travelling relation), returning at most one entry per distinct prefix (the key without its suffix),
+    // laid out as in `next_batch`. Starting from the current position, for each prefix the iterator seeks to
+    // `prefix + seek_suffix` if it is before it, takes the entry found there and then seeks to
+    // `prefix + skip_suffix`, past the rest of the prefix. Taken entries whose last byte is not zero
+    // (retractions) are skipped instead of returned.
+    inline RustBytes skip_scan_batch(size_t n, size_t max_bytes, size_t suffix_len, RustBytes seek_suffix,
+                                     RustBytes skip_suffix, RocksDbStatus &status) {
+        PerfScope scope(perf, "iter.skip_scan_batch");
+        batch.clear();
+        auto seek_suffix_s = convert_slice(seek_suffix);
+        auto skip_suffix_s = convert_slice(skip_suffix);
+        string target;
+        size_t taken = 0;
+        while (taken < n && iter->Valid()) {
+            auto k = iter->key();
+            if (r_opts->iterate_upper_bound != nullptr && k.compare(upper_bound) >= 0) {
+                break;
+            }
+            if (k.size() < suffix_len) {
+                iter->Next();
+                continue;
+            }
+            auto prefix_len = k.size() - suffix_len;
+            Slice suffix(k.data() + prefix_len, suffix_len);
+            target.assign(k.data(), prefix_len);
+            if (suffix.compare(seek_suffix_s) < 0) {
+                target.append(seek_suffix_s.data(), seek_suffix_s.size());
+                iter->Seek(target);
+                continue;
+            }
+            if (suffix[suffix_len - 1] == 0) {
+                auto v = iter->value();
+                if (taken > 0 && batch.size() + 2 * sizeof(uint32_t) + k.size() + v.size() > max_bytes) {
+                    break;
+                }
+                append_batch_entry_part(k);
+                append_batch_entry_part(v);
+                ++taken;
+            }
+            target.append(skip_suffix_s.data(), skip_suffix_s.size());
+            iter->Seek(target);
+            if (iter->Valid() && iter->key() == target) {
+                iter->Next();
+            }
+        }
+        write_status(iter->status(), status);
+        return convert_slice_back(batch);
+    }
+
+    inline void append_batch_entry_part(const Slice &part) {
+        auto len = static_cast<uint32_t>(part.size());
+        batch.append(reinterpret_cast<const char *>(&len), sizeof(len));
+        batch.append(part.data(), part.size());
+    }
+
+    // Counts the entries from the current position up to the upper bound (or the end), leaving the iterator exhausted
+    inline size_t count(RocksDbStatus &status) {
+        PerfScope scope(perf, "iter.count");
+        size_t n = 0;
+        for (; iter->Valid(); iter->Next()) {
+            ++n;
+        }
+        write_status(iter->status(), status);
+        return n;
+    }
+
     inline void status(RocksDbStatus &status) const {
         write_status(iter->status(), status);
     }
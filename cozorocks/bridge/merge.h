@@ -0,0 +1,535 @@
+// Copyright 2022, The Cozo Project Authors.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License, v. 2.0.
+// If a copy of the MPL was not distributed with this file,
+// You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef COZOROCKS_MERGE_H
+#define COZOROCKS_MERGE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "common.h"
+#include "cf.h"
+#include "rocksdb/merge_operator.h"
+
+// How a column of a merge operand is combined with the same column of the value before it,
+// see `MergeOp` on the Rust side
+static const uint8_t MERGE_KEEP = 0;
+static const uint8_t MERGE_REPLACE = 1;
+static const uint8_t MERGE_SUM = 2;
+static const uint8_t MERGE_MIN = 3;
+static const uint8_t MERGE_MAX = 4;
+static const uint8_t MERGE_UNION = 5;
+
+static const size_t MERGE_OPS_LEN_BYTES = 4;
+
+// Values are the relation id followed by the MessagePack array of the non-key columns,
+// each of them a `DataValue` as serialized by serde (`cozo-core/src/runtime/relation.rs`)
+
+inline bool mp_read_be(const Slice &data, size_t &pos, size_t n, uint64_t &out) {
+    if (pos + n > data.size()) {
+        return false;
+    }
+    out = 0;
+    for (size_t i = 0; i < n; ++i) {
+        out = (out << 8) | static_cast<uint8_t>(data[pos + i]);
+    }
+    pos += n;
+    return true;
+}
+
+inline bool mp_advance(const Slice &data, size_t &pos, uint64_t n) {
+    if (n > data.size() - pos) {
+        return false;
+    }
+    pos += n;
+    return true;
+}
+
+// Moves `pos` past the MessagePack object starting there. Returns false if it is truncated or malformed.
+inline bool mp_skip(const Slice &data, size_t &pos) {
+    if (pos >= data.size()) {
+        return false;
+    }
+    auto tag = static_cast<uint8_t>(data[pos++]);
+    uint64_t len = 0;
+    if (tag <= 0x7f || tag >= 0xe0 || tag == 0xc0 || tag == 0xc2 || tag == 0xc3) {
+        return true;
+    }
+    if ((tag & 0xe0) == 0xa0) {
+        return mp_advance(data, pos, tag & 0x1f);
+    }
+    if ((tag & 0xf0) == 0x80 || (tag & 0xf0) == 0x90) {
+        len = (tag & 0xf0) == 0x80 ? 2 * (tag & 0x0f) : tag & 0x0f;
+    } else {
+        switch (tag) {
+            case 0xc4:
+            case 0xd9:
+                return mp_read_be(data, pos, 1, len) && mp_advance(data, pos, len);
+            case 0xc5:
+            case 0xda:
+                return mp_read_be(data, pos, 2, len) && mp_advance(data, pos, len);
+            case 0xc6:
+            case 0xdb:
+                return mp_read_be(data, pos, 4, len) && mp_advance(data, pos, len);
+            case 0xc7:
+                return mp_read_be(data, pos, 1, len) && mp_advance(data, pos, len + 1);
+            case 0xc8:
+                return mp_read_be(data, pos, 2, len) && mp_advance(data, pos, len + 1);
+            case 0xc9:
+                return mp_read_be(data, pos, 4, len) && mp_advance(data, pos, len + 1);
+            case 0xcc:
+            case 0xd0:
+                return mp_advance(data, pos, 1);
+            case 0xcd:
+            case 0xd1:
+            case 0xd4:
+                return mp_advance(data, pos, 2);
+            case 0xd5:
+                return mp_advance(data, pos, 3);
+            case 0xca:
+            case 0xce:
+            case 0xd2:
+                return mp_advance(data, pos, 4);
+            case 0xd6:
+                return mp_advance(data, pos, 5);
+            case 0xcb:
+            case 0xcf:
+            case 0xd3:
+                return mp_advance(data, pos, 8);
+            case 0xd7:
+                return mp_advance(data, pos, 9);
+            case 0xd8:
+                return mp_advance(data, pos, 17);
+            case 0xdc:
+                if (!mp_read_be(data, pos, 2, len)) {
+                    return false;
+                }
+                break;
+            case 0xdd:
+                if (!mp_read_be(data, pos, 4, len)) {
+                    return false;
+                }
+                break;
+            case 0xde:
+                if (!mp_read_be(data, pos, 2, len)) {
+                    return false;
+                }
+                len *= 2;
+                break;
+            case 0xdf:
+                if (!mp_read_be(data, pos, 4, len)) {
+                    return false;
+                }
+                len *= 2;
+                break;
+            default:
+                return false;
+        }
+    }
+    for (uint64_t i = 0; i < len; ++i) {
+        if (!mp_skip(data, pos)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline bool mp_read_array_len(const Slice &data, size_t &pos, uint64_t &len) {
+    if (pos >= data.size()) {
+        return false;
+    }
+    auto tag = static_cast<uint8_t>(data[pos++]);
+    if ((tag & 0xf0) == 0x90) {
+        len = tag & 0x0f;
+        return true;
+    }
+    if (tag == 0xdc) {
+        return mp_read_be(data, pos, 2, len);
+    }
+    if (tag == 0xdd) {
+        return mp_read_be(data, pos, 4, len);
+    }
+    return false;
+}
+
+inline void mp_write_array_len(string &out, size_t len) {
+    if (len < 16) {
+        out.push_back(static_cast<char>(0x90 | len));
+    } else if (len <= 0xffff) {
+        out.push_back(static_cast<char>(0xdc));
+        out.push_back(static_cast<char>(len >> 8));
+        out.push_back(static_cast<char>(len & 0xff));
+    } else {
+        out.push_back(static_cast<char>(0xdd));
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            out.push_back(static_cast<char>((len >> shift) & 0xff));
+        }
+    }
+}
+
+// `tag` followed by the lowest `n` bytes of `v`
+inline void mp_write_be(string &out, uint8_t tag, uint64_t v, size_t n) {
+    out.push_back(static_cast<char>(tag));
+    for (auto shift = static_cast<int>(8 * n) - 8; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<char>((v >> shift) & 0xff));
+    }
+}
+
+// An identifier is either a string or an unsigned integer
+inline bool mp_read_ident(const Slice &data, size_t &pos, Slice &name, uint64_t &index) {
+    if (pos >= data.size()) {
+        return false;
+    }
+    auto tag = static_cast<uint8_t>(data[pos]);
+    uint64_t len = 0;
+    if ((tag & 0xe0) == 0xa0) {
+        len = tag & 0x1f;
+        pos += 1;
+    } else if (tag == 0xd9 || tag == 0xda || tag == 0xdb) {
+        pos += 1;
+        if (!mp_read_be(data, pos, tag == 0xd9 ? 1 : tag == 0xda ? 2 : 4, len)) {
+            return false;
+        }
+    } else if (tag <= 0x7f) {
+        index = tag;
+        name = Slice();
+        pos += 1;
+        return true;
+    } else if (tag >= 0xcc && tag <= 0xcf) {
+        pos += 1;
+        return mp_read_be(data, pos, size_t(1) << (tag - 0xcc), index);
+    } else {
+        return false;
+    }
+    if (len > data.size() - pos) {
+        return false;
+    }
+    name = Slice(data.data() + pos, len);
+    pos += len;
+    return true;
+}
+
+// A serde enum variant with content: a map of a single entry from the name or index of the variant to the
+// content, or an array of the index and the content. The raw bytes are kept, so that values are written back
+// in whatever form they were written in.
+struct MpVariant {
+    Slice name;
+    uint64_t index;
+    size_t content_pos;
+
+    [[nodiscard]] inline bool is(const char *name_, uint64_t index_) const {
+        return name.empty() ? index == index_ : name == Slice(name_);
+    }
+};
+
+inline bool mp_read_variant(const Slice &data, size_t pos, MpVariant &out) {
+    if (pos >= data.size()) {
+        return false;
+    }
+    auto tag = static_cast<uint8_t>(data[pos]);
+    if (tag != 0x81 && tag != 0x92) {
+        return false;
+    }
+    ++pos;
+    out.index = 0;
+    if (!mp_read_ident(data, pos, out.name, out.index)) {
+        return false;
+    }
+    out.content_pos = pos;
+    return true;
+}
+
+// The variant indices of `DataValue` and `Num` (`cozo-core/src/data/value.rs`)
+static const uint64_t DATA_VALUE_NUM_INDEX = 2;
+static const uint64_t DATA_VALUE_LIST_INDEX = 7;
+static const uint64_t NUM_INT_INDEX = 0;
+static const uint64_t NUM_FLOAT_INDEX = 1;
+
+struct MpNum {
+    // everything up to the number itself
+    Slice header;
+    bool is_int;
+    int64_t i;
+    double f;
+
+    [[nodiscard]] inline double as_float() const {
+        return is_int ? static_cast<double>(i) : f;
+    }
+};
+
+inline bool mp_read_num(const Slice &col, MpNum &out) {
+    MpVariant outer{};
+    MpVariant inner{};
+    if (!mp_read_variant(col, 0, outer) || !outer.is("Num", DATA_VALUE_NUM_INDEX) ||
+        !mp_read_variant(col, outer.content_pos, inner)) {
+        return false;
+    }
+    size_t pos = inner.content_pos;
+    out.header = Slice(col.data(), pos);
+    if (pos >= col.size()) {
+        return false;
+    }
+    auto tag = static_cast<uint8_t>(col[pos++]);
+    uint64_t raw = 0;
+    if (inner.is("Int", NUM_INT_INDEX)) {
+        out.is_int = true;
+        if (tag <= 0x7f) {
+            out.i = tag;
+        } else if (tag >= 0xe0) {
+            out.i = static_cast<int8_t>(tag);
+        } else if (tag >= 0xcc && tag <= 0xcf) {
+            if (!mp_read_be(col, pos, size_t(1) << (tag - 0xcc), raw)) {
+                return false;
+            }
+            out.i = static_cast<int64_t>(raw);
+        } else if (tag >= 0xd0 && tag <= 0xd3) {
+            auto n = size_t(1) << (tag - 0xd0);
+            if (!mp_read_be(col, pos, n, raw)) {
+                return false;
+            }
+            // sign-extend
+            auto shift = 64 - 8 * n;
+            out.i = shift == 0 ? static_cast<int64_t>(raw) : static_cast<int64_t>(raw << shift) >> shift;
+        } else {
+            return false;
+        }
+    } else if (inner.is("Float", NUM_FLOAT_INDEX)) {
+        out.is_int = false;
+        if (tag == 0xca) {
+            if (!mp_read_be(col, pos, 4, raw)) {
+                return false;
+            }
+            auto bits = static_cast<uint32_t>(raw);
+            float f;
+            memcpy(&f, &bits, sizeof(f));
+            out.f = f;
+        } else if (tag == 0xcb) {
+            if (!mp_read_be(col, pos, 8, raw)) {
+                return false;
+            }
+            memcpy(&out.f, &raw, sizeof(out.f));
+        } else {
+            return false;
+        }
+    } else {
+        return false;
+    }
+    return pos == col.size();
+}
+
+// In the smallest of the encodings, as rmp does, so that sums are encoded the same as the values put directly
+inline string mp_write_int(const Slice &header, int64_t i) {
+    string out(header.data(), header.size());
+    auto raw = static_cast<uint64_t>(i);
+    if (i >= 0) {
+        if (i <= 0x7f) {
+            out.push_back(static_cast<char>(i));
+        } else if (i <= 0xff) {
+            mp_write_be(out, 0xcc, raw, 1);
+        } else if (i <= 0xffff) {
+            mp_write_be(out, 0xcd, raw, 2);
+        } else if (i <= 0xffffffffLL) {
+            mp_write_be(out, 0xce, raw, 4);
+        } else {
+            mp_write_be(out, 0xcf, raw, 8);
+        }
+    } else if (i >= -32) {
+        out.push_back(static_cast<char>(static_cast<int8_t>(i)));
+    } else if (i >= INT8_MIN) {
+        mp_write_be(out, 0xd0, raw, 1);
+    } else if (i >= INT16_MIN) {
+        mp_write_be(out, 0xd1, raw, 2);
+    } else if (i >= INT32_MIN) {
+        mp_write_be(out, 0xd2, raw, 4);
+    } else {
+        mp_write_be(out, 0xd3, raw, 8);
+    }
+    return out;
+}
+
+inline string mp_write_float(const Slice &header, double f) {
+    string out(header.data(), header.size());
+    uint64_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    mp_write_be(out, 0xcb, bits, 8);
+    return out;
+}
+
+// The `List` variant, with everything up to its array as the header
+inline bool mp_read_list(const Slice &col, Slice &header, vector<Slice> &elements) {
+    MpVariant variant{};
+    if (!mp_read_variant(col, 0, variant) || !variant.is("List", DATA_VALUE_LIST_INDEX)) {
+        return false;
+    }
+    size_t pos = variant.content_pos;
+    header = Slice(col.data(), pos);
+    uint64_t len;
+    if (!mp_read_array_len(col, pos, len)) {
+        return false;
+    }
+    for (uint64_t i = 0; i < len; ++i) {
+        auto start = pos;
+        if (!mp_skip(col, pos)) {
+            return false;
+        }
+        elements.emplace_back(col.data() + start, pos - start);
+    }
+    return pos == col.size();
+}
+
+inline bool parse_row(const Slice &val, Slice &prefix, vector<Slice> &cols) {
+    if (val.size() < RELATION_ID_LEN) {
+        return false;
+    }
+    prefix = Slice(val.data(), RELATION_ID_LEN);
+    size_t pos = RELATION_ID_LEN;
+    uint64_t len;
+    if (!mp_read_array_len(val, pos, len)) {
+        return false;
+    }
+    for (uint64_t i = 0; i < len; ++i) {
+        auto start = pos;
+        if (!mp_skip(val, pos)) {
+            return false;
+        }
+        cols.emplace_back(val.data() + start, pos - start);
+    }
+    return pos == val.size();
+}
+
+// Merge operands are the number of columns with an op, the op of each of them, and then a value
+inline bool parse_merge_operand(const Slice &operand, Slice &ops, Slice &prefix, vector<Slice> &cols) {
+    size_t pos = 0;
+    uint64_t n_ops;
+    if (!mp_read_be(operand, pos, MERGE_OPS_LEN_BYTES, n_ops) || n_ops > operand.size() - pos) {
+        return false;
+    }
+    ops = Slice(operand.data() + pos, n_ops);
+    pos += n_ops;
+    return parse_row(Slice(operand.data() + pos, operand.size() - pos), prefix, cols);
+}
+
+// Combines `cur` with `operand` as `op` says. Columns that do not hold what `op` expects are replaced.
+inline string merge_column(uint8_t op, const string &cur, const Slice &operand) {
+    switch (op) {
+        case MERGE_KEEP:
+            return cur;
+        case MERGE_SUM:
+        case MERGE_MIN:
+        case MERGE_MAX: {
+            MpNum a{};
+            MpNum b{};
+            if (!mp_read_num(cur, a)) {
+                return operand.ToString();
+            }
+            if (!mp_read_num(operand, b)) {
+                return cur;
+            }
+            if (op == MERGE_SUM) {
+                if (a.is_int && b.is_int) {
+                    // wraps around like integer addition in queries
+                    auto sum = static_cast<int64_t>(static_cast<uint64_t>(a.i) + static_cast<uint64_t>(b.i));
+                    return mp_write_int(a.header, sum);
+                }
+                return mp_write_float(a.is_int ? b.header : a.header, a.as_float() + b.as_float());
+            }
+            bool b_less = a.is_int && b.is_int ? b.i < a.i : b.as_float() < a.as_float();
+            bool b_greater = a.is_int && b.is_int ? b.i > a.i : b.as_float() > a.as_float();
+            if ((op == MERGE_MIN && b_less) || (op == MERGE_MAX && b_greater)) {
+                return operand.ToString();
+            }
+            return cur;
+        }
+        case MERGE_UNION: {
+            Slice a_header, b_header;
+            vector<Slice> a_elements, b_elements;
+            if (!mp_read_list(cur, a_header, a_elements)) {
+                return operand.ToString();
+            }
+            if (!mp_read_list(operand, b_header, b_elements)) {
+                return cur;
+            }
+            // elements are compared by their encoding
+            for (auto &el: b_elements) {
+                if (std::find(a_elements.begin(), a_elements.end(), el) == a_elements.end()) {
+                    a_elements.push_back(el);
+                }
+            }
+            string out(a_header.data(), a_header.size());
+            mp_write_array_len(out, a_elements.size());
+            for (auto &el: a_elements) {
+                out.append(el.data(), el.size());
+            }
+            return out;
+        }
+        default:
+            return operand.ToString();
+    }
+}
+
+// Applies `TxBridge::merge` operands to values in the format of the non-key columns of stored relations,
+// column by column. Without a value before them, the first operand is taken as it is.
+class CozoMergeOperator : public MergeOperator {
+public:
+    static const char *kClassName() {
+        return "cozo.MergeOperator";
+    }
+
+    [[nodiscard]] const char *Name() const override {
+        return kClassName();
+    }
+
+    bool FullMergeV2(const MergeOperationInput &merge_in, MergeOperationOutput *merge_out) const override {
+        Slice prefix;
+        vector<string> cols;
+        bool has_row = false;
+        if (merge_in.existing_value != nullptr && !merge_in.existing_value->empty()) {
+            vector<Slice> existing;
+            if (!parse_row(*merge_in.existing_value, prefix, existing)) {
+                return false;
+            }
+            for (auto &col: existing) {
+                cols.push_back(col.ToString());
+            }
+            has_row = true;
+        }
+        string prefix_buf = prefix.ToString();
+        for (auto &operand: merge_in.operand_list) {
+            Slice ops;
+            Slice operand_prefix;
+            vector<Slice> operand_cols;
+            if (!parse_merge_operand(operand, ops, operand_prefix, operand_cols)) {
+                return false;
+            }
+            if (!has_row) {
+                prefix_buf = operand_prefix.ToString();
+                for (auto &col: operand_cols) {
+                    cols.push_back(col.ToString());
+                }
+                has_row = true;
+                continue;
+            }
+            for (size_t i = 0; i < operand_cols.size(); ++i) {
+                if (i >= cols.size()) {
+                    cols.push_back(operand_cols[i].ToString());
+                    continue;
+                }
+                auto op = i < ops.size() ? static_cast<uint8_t>(ops[i]) : MERGE_REPLACE;
+                cols[i] = merge_column(op, cols[i], operand_cols[i]);
+            }
+        }
+        auto &out = merge_out->new_value;
+        out = prefix_buf;
+        mp_write_array_len(out, cols.size());
+        for (auto &col: cols) {
+            out.append(col);
+        }
+        return true;
+    }
+};
+
+#endif //COZOROCKS_MERGE_H
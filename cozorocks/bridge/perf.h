@@ -0,0 +1,97 @@
+// Copyright 2022, The Cozo Project Authors.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License, v. 2.0.
+// If a copy of the MPL was not distributed with this file,
+// You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef COZOROCKS_PERF_H
+#define COZOROCKS_PERF_H
+
+#include <map>
+#include <mutex>
+
+#include "common.h"
+#include "rocksdb/perf_context.h"
+#include "rocksdb/perf_level.h"
+#include "rocksdb/iostats_context.h"
+
+// Perf and IO stats context counters of the bridge calls made through a transaction and its
+// iterators, summed per call kind and keyed as `<call>.<counter>`
+struct PerfStats {
+    std::mutex mutex;
+    map<string, uint64_t> counters;
+
+    inline void add(const char *call, const PerfContext &perf, const IOStatsContext &io) {
+        std::lock_guard<std::mutex> lock(mutex);
+        string prefix(call);
+        prefix.push_back('.');
+        auto put = [&](const char *name, uint64_t value) {
+            if (value != 0) {
+                counters[prefix + name] += value;
+            }
+        };
+        put("calls", 1);
+        put("user_key_comparison_count", perf.user_key_comparison_count);
+        put("block_cache_hit_count", perf.block_cache_hit_count);
+        put("block_cache_index_hit_count", perf.block_cache_index_hit_count);
+        put("block_cache_filter_hit_count", perf.block_cache_filter_hit_count);
+        put("secondary_cache_hit_count", perf.secondary_cache_hit_count);
+        put("block_read_count", perf.block_read_count);
+        put("block_read_byte", perf.block_read_byte);
+        put("block_read_time", perf.block_read_time);
+        put("block_decompress_time", perf.block_decompress_time);
+        put("get_snapshot_time", perf.get_snapshot_time);
+        put("get_from_memtable_count", perf.get_from_memtable_count);
+        put("get_from_memtable_time", perf.get_from_memtable_time);
+        put("get_from_output_files_time", perf.get_from_output_files_time);
+        put("seek_on_memtable_count", perf.seek_on_memtable_count);
+        put("next_on_memtable_count", perf.next_on_memtable_count);
+        put("seek_internal_seek_time", perf.seek_internal_seek_time);
+        put("find_next_user_entry_time", perf.find_next_user_entry_time);
+        put("internal_key_skipped_count", perf.internal_key_skipped_count);
+        put("internal_delete_skipped_count", perf.internal_delete_skipped_count);
+        put("internal_recent_skipped_count", perf.internal_recent_skipped_count);
+        put("bloom_memtable_hit_count", perf.bloom_memtable_hit_count);
+        put("bloom_memtable_miss_count", perf.bloom_memtable_miss_count);
+        put("bloom_sst_hit_count", perf.bloom_sst_hit_count);
+        put("bloom_sst_miss_count", perf.bloom_sst_miss_count);
+        put("key_lock_wait_count", perf.key_lock_wait_count);
+        put("key_lock_wait_time", perf.key_lock_wait_time);
+        put("write_wal_time", perf.write_wal_time);
+        put("write_memtable_time", perf.write_memtable_time);
+        put("write_delay_time", perf.write_delay_time);
+        put("io.bytes_read", io.bytes_read);
+        put("io.bytes_written", io.bytes_written);
+        put("io.read_nanos", io.read_nanos);
+        put("io.cpu_read_nanos", io.cpu_read_nanos);
+        put("io.open_nanos", io.open_nanos);
+    }
+};
+
+// Collects the perf context of the calling thread over its lifetime into `stats`, if there is one.
+// The perf context is thread-local, so scopes must not be nested.
+struct PerfScope {
+    PerfStats *stats;
+    const char *call;
+    PerfLevel prev_level;
+
+    PerfScope(PerfStats *stats_, const char *call_) : stats(stats_), call(call_), prev_level(PerfLevel::kDisable) {
+        if (stats != nullptr) {
+            prev_level = GetPerfLevel();
+            SetPerfLevel(PerfLevel::kEnableTimeExceptForMutex);
+            get_perf_context()->Reset();
+            get_iostats_context()->Reset();
+        }
+    }
+
+    PerfScope(const PerfScope &) = delete;
+
+    ~PerfScope() {
+        if (stats != nullptr) {
+            stats->add(call, *get_perf_context(), *get_iostats_context());
+            SetPerfLevel(prev_level);
+        }
+    }
+};
+
+#endif //COZOROCKS_PERF_H
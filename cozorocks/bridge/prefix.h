@@ -0,0 +1,170 @@
+// Copyright 2022, The Cozo Project Authors.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License, v. 2.0.
+// If a copy of the MPL was not distributed with this file,
+// You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef COZOROCKS_PREFIX_H
+#define COZOROCKS_PREFIX_H
+
+#include "common.h"
+#include "cf.h"
+#include "slice.h"
+
+// Tags of the memcmp encoding of values in keys (`cozo-core/src/data/memcmp.rs`)
+static const uint8_t KEY_INIT_TAG = 0x00;
+static const uint8_t KEY_NULL_TAG = 0x01;
+static const uint8_t KEY_FALSE_TAG = 0x02;
+static const uint8_t KEY_TRUE_TAG = 0x03;
+static const uint8_t KEY_VEC_TAG = 0x04;
+static const uint8_t KEY_NUM_TAG = 0x05;
+static const uint8_t KEY_STR_TAG = 0x06;
+static const uint8_t KEY_BYTES_TAG = 0x07;
+static const uint8_t KEY_UUID_TAG = 0x08;
+static const uint8_t KEY_REGEX_TAG = 0x09;
+static const uint8_t KEY_LIST_TAG = 0x0A;
+static const uint8_t KEY_SET_TAG = 0x0B;
+static const uint8_t KEY_VLD_TAG = 0x0C;
+static const uint8_t KEY_JSON_TAG = 0x0D;
+static const uint8_t KEY_BOT_TAG = 0xFF;
+
+static const uint8_t KEY_VEC_F32 = 0x01;
+static const uint8_t KEY_NUM_IS_APPROX_INT = 0b00000100;
+static const size_t KEY_BYTES_GROUP_SIZE = 8;
+static const uint8_t KEY_BYTES_MARKER = 0xFF;
+
+// Moves `pos` past the encoded value starting there. Returns false if the value is truncated or malformed.
+inline bool skip_encoded_value(const Slice &key, size_t &pos) {
+    if (pos >= key.size()) {
+        return false;
+    }
+    auto tag = static_cast<uint8_t>(key[pos++]);
+    switch (tag) {
+        case KEY_NULL_TAG:
+        case KEY_FALSE_TAG:
+        case KEY_TRUE_TAG:
+        case KEY_BOT_TAG:
+            return true;
+        case KEY_NUM_TAG:
+            // order-encoded float, then whether it is an exact integer, followed by the integer if not
+            pos += 9;
+            if (pos > key.size()) {
+                return false;
+            }
+            if (static_cast<uint8_t>(key[pos - 1]) == KEY_NUM_IS_APPROX_INT) {
+                pos += 8;
+            }
+            return pos <= key.size();
+        case KEY_STR_TAG:
+        case KEY_BYTES_TAG:
+        case KEY_REGEX_TAG:
+        case KEY_JSON_TAG:
+            // groups of 8 bytes each followed by a marker, the last group has a marker below 0xFF
+            while (true) {
+                pos += KEY_BYTES_GROUP_SIZE + 1;
+                if (pos > key.size()) {
+                    return false;
+                }
+                if (static_cast<uint8_t>(key[pos - 1]) != KEY_BYTES_MARKER) {
+                    return true;
+                }
+            }
+        case KEY_UUID_TAG:
+            pos += 16;
+            return pos <= key.size();
+        case KEY_LIST_TAG:
+        case KEY_SET_TAG:
+            while (pos < key.size() && static_cast<uint8_t>(key[pos]) != KEY_INIT_TAG) {
+                if (!skip_encoded_value(key, pos)) {
+                    return false;
+                }
+            }
+            if (pos >= key.size()) {
+                return false;
+            }
+            ++pos;
+            return true;
+        case KEY_VLD_TAG:
+            pos += 9;
+            return pos <= key.size();
+        case KEY_VEC_TAG: {
+            if (pos + 9 > key.size()) {
+                return false;
+            }
+            size_t el_size = static_cast<uint8_t>(key[pos]) == KEY_VEC_F32 ? 4 : 8;
+            uint64_t len = 0;
+            for (size_t i = 1; i <= 8; ++i) {
+                len = (len << 8) | static_cast<uint8_t>(key[pos + i]);
+            }
+            pos += 9;
+            if (len > (key.size() - pos) / el_size) {
+                return false;
+            }
+            pos += len * el_size;
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+// Prefix of keys made of the relation id and the first `n_columns` key columns, so that prefix Bloom
+// filters serve scans and lookups on the leading key columns of a relation. Keys with fewer columns,
+// such as the bounds of scans over whole relations, are outside of the domain and only use whole key filters.
+// Registered under the name `cozo.KeyColumns.<n_columns>`, which can be used in options strings.
+class KeyColumnsPrefixTransform : public SliceTransform {
+    size_t n_columns;
+    string name;
+
+public:
+    explicit KeyColumnsPrefixTransform(size_t n_columns_) :
+            n_columns(n_columns_), name(string(kClassName()) + "." + to_string(n_columns_)) {}
+
+    static const char *kClassName() {
+        return "cozo.KeyColumns";
+    }
+
+    [[nodiscard]] const char *Name() const override {
+        return kClassName();
+    }
+
+    [[nodiscard]] std::string GetId() const override {
+        return name;
+    }
+
+    [[nodiscard]] bool IsInstanceOf(const std::string &id) const override {
+        return id == name || SliceTransform::IsInstanceOf(id);
+    }
+
+    // Length of the prefix of `key`, or 0 if it is not in the domain
+    [[nodiscard]] inline size_t prefix_len(const Slice &key) const {
+        if (key.size() < RELATION_ID_LEN) {
+            return 0;
+        }
+        size_t pos = RELATION_ID_LEN;
+        for (size_t i = 0; i < n_columns; ++i) {
+            if (!skip_encoded_value(key, pos)) {
+                return 0;
+            }
+        }
+        return pos;
+    }
+
+    [[nodiscard]] Slice Transform(const Slice &key) const override {
+        return {key.data(), prefix_len(key)};
+    }
+
+    [[nodiscard]] bool InDomain(const Slice &key) const override {
+        return prefix_len(key) != 0;
+    }
+};
+
+// Length of the prefix that `cozo.KeyColumns.<n_columns>` takes from `key`, 0 if the key is outside of its domain
+inline size_t key_columns_prefix_len(RustBytes key, size_t n_columns) {
+    return KeyColumnsPrefixTransform(n_columns).prefix_len(convert_slice(key));
+}
+
+// Makes `cozo.KeyColumns.<n>` known to RocksDB, which is needed to open databases whose persisted options refer to it
+void register_key_columns_prefix_transform();
+
+#endif //COZOROCKS_PREFIX_H
@@ -21,6 +21,15 @@ inline string convert_slice_to_string(RustBytes d) {
     return {reinterpret_cast<const char *>(d.data()), d.size()};
 }
 
+inline rust::Vec<uint8_t> convert_slice_to_vec(const Slice &s) {
+    rust::Vec<uint8_t> ret;
+    ret.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i) {
+        ret.push_back(static_cast<uint8_t>(s[i]));
+    }
+    return ret;
+}
+
 inline RustBytes convert_slice_back(const Slice &s) {
     return {reinterpret_cast<const std::uint8_t *>(s.data()), s.size()};
 }
@@ -0,0 +1,146 @@
+// Copyright 2022, The Cozo Project Authors.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License, v. 2.0.
+// If a copy of the MPL was not distributed with this file,
+// You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef COZOROCKS_TTL_H
+#define COZOROCKS_TTL_H
+
+#include <chrono>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "common.h"
+#include "prefix.h"
+#include "rocksdb/compaction_filter.h"
+
+static const size_t KEY_VLD_LEN = 10;
+static const uint64_t KEY_SIGN_MARK = 0x8000000000000000;
+
+struct ValidityRetention {
+    // in microseconds, like the timestamps of validities
+    int64_t retention;
+    // also drop the version of a row that is current at the horizon, so that rows not
+    // asserted or retracted since then disappear altogether
+    bool expire_current;
+};
+
+// Start of the validity ending `key`, if its last column is one
+inline bool validity_of_key(const Slice &key, size_t &vld_pos, int64_t &ts) {
+    size_t pos = RELATION_ID_LEN;
+    size_t last = pos;
+    while (pos < key.size()) {
+        last = pos;
+        if (!skip_encoded_value(key, pos)) {
+            return false;
+        }
+    }
+    if (pos != key.size() || last + KEY_VLD_LEN != key.size() || static_cast<uint8_t>(key[last]) != KEY_VLD_TAG) {
+        return false;
+    }
+    // see `cozo-core/src/data/memcmp.rs`: the flipped, order-encoded timestamp, then whether it retracts
+    uint64_t flipped = 0;
+    for (size_t i = 1; i <= 8; ++i) {
+        flipped = (flipped << 8) | static_cast<uint8_t>(key[last + i]);
+    }
+    ts = static_cast<int64_t>(~flipped ^ KEY_SIGN_MARK);
+    vld_pos = last;
+    return true;
+}
+
+// Drops the versions of the rows of time travel relations that are older than the horizon of their relation.
+// The versions of a row are ordered from the newest, so the first one at or before the horizon is the one
+// current at the horizon, which is kept so that time travel to the horizon or later sees the same data.
+// The versions after it are only dropped if they are in the same compaction, which is always safe.
+class ValidityRetentionFilter : public CompactionFilter {
+    // relation id to horizon in microseconds, and whether to expire the version current at the horizon
+    unordered_map<uint64_t, pair<int64_t, bool>> horizons;
+    // compactions run a filter of their own on a single thread, in the order of the keys
+    mutable string last_row;
+    mutable bool last_row_has_current;
+
+public:
+    explicit ValidityRetentionFilter(unordered_map<uint64_t, pair<int64_t, bool>> horizons_) :
+            horizons(std::move(horizons_)), last_row(), last_row_has_current(false) {}
+
+    [[nodiscard]] const char *Name() const override {
+        return "cozo.ValidityRetentionFilter";
+    }
+
+    bool Filter(int, const Slice &key, const Slice &, string *, bool *) const override {
+        return should_drop(key);
+    }
+
+    inline bool should_drop(const Slice &key) const {
+        uint64_t rel_id;
+        if (!relation_id_of_key(key, rel_id)) {
+            return false;
+        }
+        auto found = horizons.find(rel_id);
+        if (found == horizons.end()) {
+            return false;
+        }
+        size_t vld_pos;
+        int64_t ts;
+        if (!validity_of_key(key, vld_pos, ts)) {
+            return false;
+        }
+        auto horizon = found->second.first;
+        if (found->second.second) {
+            return ts < horizon;
+        }
+        Slice row(key.data(), vld_pos);
+        if (row != Slice(last_row)) {
+            last_row.assign(row.data(), row.size());
+            last_row_has_current = false;
+        }
+        if (ts > horizon) {
+            return false;
+        }
+        if (last_row_has_current) {
+            return true;
+        }
+        last_row_has_current = true;
+        return false;
+    }
+};
+
+// Relations are registered at runtime, and compactions starting afterwards pick them up,
+// with the horizon taken when the compaction starts
+class ValidityRetentionFilterFactory : public CompactionFilterFactory {
+    mutable std::shared_mutex mutex;
+    unordered_map<uint64_t, ValidityRetention> retentions;
+
+public:
+    [[nodiscard]] const char *Name() const override {
+        return "cozo.ValidityRetentionFilterFactory";
+    }
+
+    inline void set(uint64_t rel_id, ValidityRetention retention) {
+        std::unique_lock lock(mutex);
+        retentions[rel_id] = retention;
+    }
+
+    inline void clear(uint64_t rel_id) {
+        std::unique_lock lock(mutex);
+        retentions.erase(rel_id);
+    }
+
+    unique_ptr<CompactionFilter> CreateCompactionFilter(const CompactionFilter::Context &) override {
+        std::shared_lock lock(mutex);
+        if (retentions.empty()) {
+            return nullptr;
+        }
+        auto now = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        unordered_map<uint64_t, pair<int64_t, bool>> horizons;
+        for (auto &kv: retentions) {
+            horizons[kv.first] = {static_cast<int64_t>(now) - kv.second.retention, kv.second.expire_current};
+        }
+        return make_unique<ValidityRetentionFilter>(std::move(horizons));
+    }
+};
+
+#endif //COZOROCKS_TTL_H
@@ -6,6 +6,7 @@
 
 #include "tx.h"
 #include "cozorocks/src/bridge/mod.rs.h"
+#include "rocksdb/experimental.h"
 
 void TxBridge::start() {
     if (odb != nullptr) {
@@ -14,6 +15,133 @@ void TxBridge::start() {
     } else if (tdb != nullptr) {
         Transaction *txn = tdb->BeginTransaction(*w_opts, *p_tx_opts);
         tx.reset(txn);
+    } else {
+        // the database cannot be written to
+        start_read_only();
+        return;
     }
     assert(tx);
-}
\ No newline at end of file
+}
+
+void TxBridge::start_read_only() {
+    DB *db_ = write_unprepared ? tdb : base_db;
+    read_snapshot = make_unique<SnapshotBridge>(db_->GetSnapshot(), db_);
+    r_opts->snapshot = read_snapshot->snapshot;
+}
+
+Status TxBridge::delete_ranges() {
+    WriteBatch batch;
+    for (auto &range: ranges_to_delete) {
+        auto s = batch.DeleteRange(cf_for(range.first), range.first, range.second);
+        if (!s.ok()) {
+            return s;
+        }
+    }
+    auto s = base_db->Write(*w_opts, &batch);
+    if (!s.ok()) {
+        return s;
+    }
+    // let the background compactions get rid of the deleted range soon, without waiting for it
+    for (auto &range: ranges_to_delete) {
+        Slice begin(range.first);
+        Slice end(range.second);
+        experimental::SuggestCompactRange(base_db, cf_for(begin), &begin, &end);
+    }
+    ranges_to_delete.clear();
+    return s;
+}
+
+void TxBridge::commit(RocksDbStatus &status) {
+    if (read_snapshot) {
+        // ranges and column families can only be dropped by a transaction that may write
+        write_status(ranges_to_delete.empty() && cfs_to_drop.empty() ? Status::OK() : read_only_error(), status);
+        return;
+    }
+    if (write_unprepared && !ranges_to_delete.empty()) {
+        // the transaction database does not support range deletions with this policy, and writing
+        // them to the base database would go around its record of which writes are committed
+        write_status(Status::NotSupported("ranges cannot be deleted with large transactions"), status);
+        return;
+    }
+    PerfScope scope(perf.get(), "commit");
+    auto s = par_batches.apply_to(tx.get());
+    if (s.ok()) {
+        s = tx->Commit();
+    }
+    if (s.ok() && !ranges_to_delete.empty()) {
+        s = delete_ranges();
+    }
+    if (s.ok() && cfs != nullptr) {
+        for (auto rel_id: cfs_to_drop) {
+            s = cfs->drop(rel_id);
+            if (!s.ok()) {
+                break;
+            }
+        }
+        cfs_to_drop.clear();
+    }
+    write_status(s, status);
+}
+
+unique_ptr<MultiGetBridge> TxBridge::multi_get(RustBytes keys, rust::Slice<const size_t> key_lens, bool for_update) const {
+    PerfScope scope(perf.get(), "multi_get");
+    auto n = key_lens.size();
+    auto ret = make_unique<MultiGetBridge>(n);
+    vector<Slice> key_slices;
+    key_slices.reserve(n);
+    auto data = reinterpret_cast<const char *>(keys.data());
+    size_t offset = 0;
+    for (auto len: key_lens) {
+        key_slices.emplace_back(data + offset, len);
+        offset += len;
+    }
+    if (n == 0) {
+        return ret;
+    }
+    vector<ColumnFamilyHandle *> key_cfs;
+    key_cfs.reserve(n);
+    bool single_cf = true;
+    for (auto &key_slice: key_slices) {
+        key_cfs.push_back(cf_for(key_slice));
+        single_cf = single_cf && key_cfs.back() == key_cfs.front();
+    }
+    if (read_snapshot) {
+        auto base_db = read_snapshot->db;
+        if (single_cf) {
+            base_db->MultiGet(*r_opts, key_cfs.front(), n, key_slices.data(), ret->values.data(),
+                              ret->statuses.data());
+        } else {
+            base_db->MultiGet(*r_opts, n, key_cfs.data(), key_slices.data(), ret->values.data(),
+                              ret->statuses.data());
+        }
+    } else if (for_update) {
+        vector<string> found;
+        auto statuses = tx->MultiGetForUpdate(*r_opts, key_cfs, key_slices, &found);
+        for (size_t i = 0; i < n; ++i) {
+            ret->statuses[i] = std::move(statuses[i]);
+            if (ret->statuses[i].ok()) {
+                *ret->values[i].GetSelf() = std::move(found[i]);
+                ret->values[i].PinSelf();
+            }
+        }
+    } else if (single_cf) {
+        tx->MultiGet(*r_opts, key_cfs.front(), n, key_slices.data(), ret->values.data(), ret->statuses.data());
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            ret->statuses[i] = tx->Get(*r_opts, key_cfs[i], key_slices[i], &ret->values[i]);
+        }
+    }
+    return ret;
+}
+
+rust::Vec<DbStat> TxBridge::perf_stats() const {
+    rust::Vec<DbStat> ret;
+    if (!perf) {
+        return ret;
+    }
+    std::lock_guard<std::mutex> lock(perf->mutex);
+    for (auto &kv: perf->counters) {
+        ret.push_back(DbStat{rust::String(kv.first), kv.second});
+    }
+    return ret;
+}
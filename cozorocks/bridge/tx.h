@@ -7,31 +7,193 @@
 #ifndef COZOROCKS_TX_H
 #define COZOROCKS_TX_H
 
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+
 #include "common.h"
 #include "slice.h"
 #include "status.h"
 #include "iter.h"
+#include "cf.h"
+#include "perf.h"
+
+struct MultiGetBridge {
+    vector<PinnableSlice> values;
+    vector<Status> statuses;
+
+    explicit MultiGetBridge(size_t n) : values(n), statuses(n) {}
+
+    [[nodiscard]] inline size_t size() const {
+        return values.size();
+    }
+
+    inline void status_at(size_t idx, RocksDbStatus &status) const {
+        write_status(statuses[idx], status);
+    }
+
+    [[nodiscard]] inline RustBytes val_at(size_t idx) const {
+        return convert_pinnable_slice_back(values[idx]);
+    }
+};
+
+struct SnapshotBridge {
+    const Snapshot *snapshot;
+    DB *db;
+
+    explicit SnapshotBridge(const Snapshot *snapshot_, DB *db_) : snapshot(snapshot_), db(db_) {}
+
+    ~SnapshotBridge() {
+        db->ReleaseSnapshot(snapshot);
+//        printf("released snapshot\n");
+    }
+};
+
+// Writes made through a transaction from several threads at once. Each thread fills a batch of
+// its own without taking locks, and the batches are added to the transaction in one go before it
+// commits, since a RocksDB transaction cannot be written to from several threads.
+struct ParallelWriteBatches {
+    std::shared_mutex mutex;
+    unordered_map<std::thread::id, unique_ptr<WriteBatch>> batches;
+
+    // the batch of the calling thread, which only this thread touches until `apply_to` or `clear`
+    inline WriteBatch &for_thread() {
+        auto id = std::this_thread::get_id();
+        {
+            std::shared_lock lock(mutex);
+            auto found = batches.find(id);
+            if (found != batches.end()) {
+                return *found->second;
+            }
+        }
+        std::unique_lock lock(mutex);
+        auto &batch = batches[id];
+        if (batch == nullptr) {
+            batch = make_unique<WriteBatch>();
+        }
+        return *batch;
+    }
+
+    // Must not run concurrently with writes, e.g. once all the writing threads are joined
+    inline Status apply_to(Transaction *tx) {
+        std::unique_lock lock(mutex);
+        for (auto &kv: batches) {
+            if (kv.second->Count() == 0) {
+                continue;
+            }
+            // locks or tracks the keys for conflict checking, as writing them one by one would
+            auto s = tx->RebuildFromWriteBatch(kv.second.get());
+            if (!s.ok()) {
+                return s;
+            }
+            kv.second->Clear();
+        }
+        return Status::OK();
+    }
+
+    inline void clear() {
+        std::unique_lock lock(mutex);
+        batches.clear();
+    }
+};
 
 struct TxBridge {
     OptimisticTransactionDB *odb;
     TransactionDB *tdb;
+    // the database underneath `odb` or `tdb`, or the database itself if it can only be read
+    DB *base_db;
     unique_ptr<Transaction> tx;
     unique_ptr<WriteOptions> w_opts;
     unique_ptr<ReadOptions> r_opts;
     unique_ptr<OptimisticTransactionOptions> o_tx_opts;
     unique_ptr<TransactionOptions> p_tx_opts;
     ColumnFamilyHandle * cf_handle;
+    // only set if each relation is stored in its own column family
+    RelationColumnFamilies *cfs;
+    vector<uint64_t> cfs_to_drop;
+    vector<pair<string, string>> ranges_to_delete;
+    // set for the write-unprepared transactions of `large_transactions`
+    bool write_unprepared;
+    // only set for read-only transactions, which have no `tx` and read the base database directly
+    unique_ptr<SnapshotBridge> read_snapshot;
+    // only set once `enable_perf_stats` is called
+    unique_ptr<PerfStats> perf;
+    // slices of `get_pinned` that have been given back, reused by later reads
+    mutable std::mutex pinned_pool_mutex;
+    mutable vector<unique_ptr<PinnableSlice>> pinned_pool;
+    // handed to the iterators of write-unprepared transactions, see `IterBridge::tx_iters_mutex`
+    mutable std::mutex iters_mutex;
+    mutable ParallelWriteBatches par_batches;
 
-    explicit TxBridge(TransactionDB *tdb_, ColumnFamilyHandle * cf_handle_) :
+    static const size_t MAX_PINNED_POOL_SIZE = 64;
+
+    explicit TxBridge(TransactionDB *tdb_, ColumnFamilyHandle * cf_handle_, RelationColumnFamilies *cfs_) :
             odb(nullptr),
             tdb(tdb_),
+            base_db(tdb_->GetBaseDB()),
             tx(),
             w_opts(new WriteOptions),
             r_opts(new ReadOptions),
             o_tx_opts(nullptr),
             p_tx_opts(new TransactionOptions),
-            cf_handle(cf_handle_) {
-        r_opts->ignore_range_deletions = true;
+            cf_handle(cf_handle_),
+            cfs(cfs_),
+            cfs_to_drop(),
+            ranges_to_delete(),
+            write_unprepared(false),
+            read_snapshot(),
+            perf(),
+            pinned_pool_mutex(),
+            pinned_pool(),
+            iters_mutex() {}
+
+    explicit TxBridge(OptimisticTransactionDB *odb_, ColumnFamilyHandle * cf_handle_, RelationColumnFamilies *cfs_) :
+            odb(odb_),
+            tdb(nullptr),
+            base_db(odb_->GetBaseDB()),
+            tx(),
+            w_opts(new WriteOptions),
+            r_opts(new ReadOptions),
+            o_tx_opts(new OptimisticTransactionOptions),
+            p_tx_opts(nullptr),
+            cf_handle(cf_handle_),
+            cfs(cfs_),
+            cfs_to_drop(),
+            ranges_to_delete(),
+            write_unprepared(false),
+            read_snapshot(),
+            perf(),
+            pinned_pool_mutex(),
+            pinned_pool(),
+            iters_mutex() {}
+
+    // For databases opened read-only or as secondaries, on which all transactions are read-only
+    explicit TxBridge(DB *base_db_, ColumnFamilyHandle * cf_handle_, RelationColumnFamilies *cfs_) :
+            odb(nullptr),
+            tdb(nullptr),
+            base_db(base_db_),
+            tx(),
+            w_opts(new WriteOptions),
+            r_opts(new ReadOptions),
+            o_tx_opts(nullptr),
+            p_tx_opts(nullptr),
+            cf_handle(cf_handle_),
+            cfs(cfs_),
+            cfs_to_drop(),
+            ranges_to_delete(),
+            write_unprepared(false),
+            read_snapshot(),
+            perf(),
+            pinned_pool_mutex(),
+            pinned_pool(),
+            iters_mutex() {}
+
+    [[nodiscard]] inline ColumnFamilyHandle *cf_for(const Slice &key) const {
+        if (cfs == nullptr) {
+            return cf_handle;
+        }
+        return cfs->for_key(key);
     }
 
     inline WriteOptions &get_w_opts() {
@@ -50,12 +212,25 @@ struct TxBridge {
         r_opts->fill_cache = val;
     }
 
+    // Iterators can be created from several threads at once, as by parallel rule evaluation and
+    // index population. RocksDB transactions do not allow this by themselves: write-unprepared
+    // ones track their iterators, so those serialize creating and destroying them.
     inline unique_ptr<IterBridge> iterator() const {
-        return make_unique<IterBridge>(&*tx);
+        auto ret = make_unique<IterBridge>(tx.get(), cfs);
+        if (read_snapshot) {
+            ret->db = read_snapshot->db;
+            ret->set_snapshot(read_snapshot->snapshot);
+        } else if (write_unprepared) {
+            ret->tx_iters_mutex = &iters_mutex;
+        }
+        ret->perf = perf.get();
+        return ret;
     };
 
     inline void set_snapshot(bool val) {
-        if (tx != nullptr) {
+        if (read_snapshot) {
+            return;
+        } else if (tx != nullptr) {
             if (val) {
                 tx->SetSnapshot();
             }
@@ -67,70 +242,232 @@ struct TxBridge {
     }
 
     inline void clear_snapshot() {
-        tx->ClearSnapshot();
+        if (tx != nullptr) {
+            tx->ClearSnapshot();
+        }
     }
 
     [[nodiscard]] inline DB *get_db() const {
         if (tdb != nullptr) {
             return tdb;
-        } else {
+        } else if (odb != nullptr) {
             return odb;
+        } else {
+            return base_db;
         }
     }
 
     void start();
 
-    inline unique_ptr<PinnableSlice> get(RustBytes key, bool for_update, RocksDbStatus &status) const {
+    // Starts a transaction without a RocksDB transaction behind it: reads go to the base database
+    // at a snapshot, and there is nothing to lock, track or write. Writes fail. With write-unprepared
+    // transactions, reads go through the transaction database instead, which leaves out the data
+    // that transactions not committed yet have already written.
+    void start_read_only();
+
+    // Collects the perf context of the reads and writes made from now on through this
+    // transaction and the iterators it creates afterwards
+    inline void enable_perf_stats() {
+        if (!perf) {
+            perf = make_unique<PerfStats>();
+        }
+    }
+
+    [[nodiscard]] rust::Vec<DbStat> perf_stats() const;
+
+    inline void read_into(RustBytes key, bool for_update, PinnableSlice &val, RocksDbStatus &status) const {
+        PerfScope scope(perf.get(), "get");
         Slice key_ = convert_slice(key);
-        auto ret = make_unique<PinnableSlice>();
-        if (for_update) {
-            auto s = tx->GetForUpdate(*r_opts, cf_handle, key_, &*ret);
+        auto cf = cf_for(key_);
+        if (read_snapshot) {
+            auto s = read_snapshot->db->Get(*r_opts, cf, key_, &val);
+            write_status(s, status);
+        } else if (for_update) {
+            auto s = tx->GetForUpdate(*r_opts, cf, key_, &val);
             write_status(s, status);
         } else {
-            auto s = tx->Get(*r_opts, key_, &*ret);
+            auto s = tx->Get(*r_opts, cf, key_, &val);
             write_status(s, status);
         }
+    }
+
+    inline unique_ptr<PinnableSlice> get(RustBytes key, bool for_update, RocksDbStatus &status) const {
+        auto ret = make_unique<PinnableSlice>();
+        read_into(key, for_update, *ret, status);
+        return ret;
+    }
+
+    // Same as `get`, but reuses a slice given back with `recycle_pinned` if there is one.
+    // Values found in the block cache stay pinned there until the slice is recycled.
+    inline unique_ptr<PinnableSlice> get_pinned(RustBytes key, bool for_update, RocksDbStatus &status) const {
+        unique_ptr<PinnableSlice> ret;
+        {
+            std::lock_guard<std::mutex> lock(pinned_pool_mutex);
+            if (!pinned_pool.empty()) {
+                ret = std::move(pinned_pool.back());
+                pinned_pool.pop_back();
+            }
+        }
+        if (!ret) {
+            ret = make_unique<PinnableSlice>();
+        }
+        read_into(key, for_update, *ret, status);
         return ret;
     }
 
+    inline void recycle_pinned(unique_ptr<PinnableSlice> slice) const {
+        slice->Reset();
+        std::lock_guard<std::mutex> lock(pinned_pool_mutex);
+        if (pinned_pool.size() < MAX_PINNED_POOL_SIZE) {
+            pinned_pool.push_back(std::move(slice));
+        }
+    }
+
+    // `keys` holds all keys concatenated, `key_lens` the length of each of them in order
+    unique_ptr<MultiGetBridge> multi_get(RustBytes keys, rust::Slice<const size_t> key_lens, bool for_update) const;
+
     inline void exists(RustBytes key, bool for_update, RocksDbStatus &status) const {
-        Slice key_ = convert_slice(key);
         auto ret = PinnableSlice();
-        if (for_update) {
-            auto s = tx->GetForUpdate(*r_opts, cf_handle, key_, &ret);
-            write_status(s, status);
-        } else {
-            auto s = tx->Get(*r_opts, key_, &ret);
+        read_into(key, for_update, ret, status);
+    }
+
+    inline void put(RustBytes key, RustBytes val, RocksDbStatus &status) const {
+        if (read_snapshot) {
+            write_status(read_only_error(), status);
+            return;
+        }
+        PerfScope scope(perf.get(), "put");
+        auto key_ = convert_slice(key);
+        if (cfs == nullptr) {
+            write_status(tx->Put(key_, convert_slice(val)), status);
+            return;
+        }
+        Status s;
+        auto cf = cfs->for_write(key_, s);
+        if (!s.ok()) {
             write_status(s, status);
+            return;
         }
+        write_status(tx->Put(cf, key_, convert_slice(val)), status);
     }
 
-    inline void put(RustBytes key, RustBytes val, RocksDbStatus &status) const {
-        write_status(tx->Put(convert_slice(key), convert_slice(val)), status);
+    // Blind write of a `CozoMergeOperator` operand, which is combined with the value of `key` when it is read
+    inline void merge(RustBytes key, RustBytes operand, RocksDbStatus &status) const {
+        if (read_snapshot) {
+            write_status(read_only_error(), status);
+            return;
+        }
+        PerfScope scope(perf.get(), "merge");
+        auto key_ = convert_slice(key);
+        if (cfs == nullptr) {
+            write_status(tx->Merge(key_, convert_slice(operand)), status);
+            return;
+        }
+        Status s;
+        auto cf = cfs->for_write(key_, s);
+        if (!s.ok()) {
+            write_status(s, status);
+            return;
+        }
+        write_status(tx->Merge(cf, key_, convert_slice(operand)), status);
     }
 
     inline void del(RustBytes key, RocksDbStatus &status) const {
-        write_status(tx->Delete(convert_slice(key)), status);
+        if (read_snapshot) {
+            write_status(read_only_error(), status);
+            return;
+        }
+        PerfScope scope(perf.get(), "del");
+        auto key_ = convert_slice(key);
+        write_status(tx->Delete(cf_for(key_), key_), status);
+    }
+
+    // Same as `put`, but can be called from several threads at once. The write only becomes part
+    // of the transaction, and visible to its reads, once `par_flush` or `commit` is called.
+    inline void par_put(RustBytes key, RustBytes val, RocksDbStatus &status) const {
+        if (read_snapshot) {
+            write_status(read_only_error(), status);
+            return;
+        }
+        PerfScope scope(perf.get(), "par_put");
+        auto key_ = convert_slice(key);
+        Status s;
+        auto cf = cfs == nullptr ? cf_handle : cfs->for_write(key_, s);
+        if (!s.ok()) {
+            write_status(s, status);
+            return;
+        }
+        write_status(par_batches.for_thread().Put(cf, key_, convert_slice(val)), status);
+    }
+
+    // Same as `del`, in the same way as `par_put`
+    inline void par_del(RustBytes key, RocksDbStatus &status) const {
+        if (read_snapshot) {
+            write_status(read_only_error(), status);
+            return;
+        }
+        PerfScope scope(perf.get(), "par_del");
+        auto key_ = convert_slice(key);
+        write_status(par_batches.for_thread().Delete(cf_for(key_), key_), status);
+    }
+
+    // Adds the writes of `par_put` and `par_del` to the transaction, once no thread makes them any more
+    inline void par_flush(RocksDbStatus &status) {
+        if (read_snapshot) {
+            write_status(Status::OK(), status);
+            return;
+        }
+        PerfScope scope(perf.get(), "par_flush");
+        write_status(par_batches.apply_to(tx.get()), status);
+    }
+
+    [[nodiscard]] inline rust::Vec<uint64_t> relation_cfs_in_range(RustBytes lower, RustBytes upper) const {
+        if (cfs == nullptr) {
+            return {};
+        }
+        return cfs->in_range(convert_slice(lower), convert_slice(upper));
+    }
+
+    // The column family is dropped only once the transaction has committed successfully
+    inline void drop_relation_cf_on_commit(uint64_t rel_id) {
+        cfs_to_drop.push_back(rel_id);
     }
 
-    inline void commit(RocksDbStatus &status) {
-        write_status(tx->Commit(), status);
+    // RocksDB transactions cannot delete ranges, so the range is deleted with a DeleteRange
+    // right after the transaction has committed successfully, outside of the transaction.
+    // Only use this for keys that nothing can read or write any more once the transaction
+    // commits, such as those of a destroyed relation. Not supported by write-unprepared
+    // transactions, whose commit fails if there are ranges to delete.
+    inline void del_range_on_commit(RustBytes lower, RustBytes upper) {
+        ranges_to_delete.emplace_back(convert_slice_to_string(lower), convert_slice_to_string(upper));
     }
 
+    Status delete_ranges();
+
+    void commit(RocksDbStatus &status);
+
+    // a read-only transaction has nothing to roll back
     inline void rollback(RocksDbStatus &status) {
-        write_status(tx->Rollback(), status);
+        par_batches.clear();
+        write_status(read_snapshot ? Status::OK() : tx->Rollback(), status);
     }
 
     inline void rollback_to_savepoint(RocksDbStatus &status) {
-        write_status(tx->RollbackToSavePoint(), status);
+        write_status(read_snapshot ? Status::OK() : tx->RollbackToSavePoint(), status);
     }
 
     inline void pop_savepoint(RocksDbStatus &status) {
-        write_status(tx->PopSavePoint(), status);
+        write_status(read_snapshot ? Status::OK() : tx->PopSavePoint(), status);
     }
 
     inline void set_savepoint() {
-        tx->SetSavePoint();
+        if (tx != nullptr) {
+            tx->SetSavePoint();
+        }
+    }
+
+    static inline Status read_only_error() {
+        return Status::NotSupported("write in a read-only transaction");
     }
 };
 
@@ -10,6 +10,15 @@ use std::env::var;
 use std::path::{Path, PathBuf};
 use std::{env, fs, process::Command};
 
+/// Linking is left to `main`, which must link liburing after rocksdb.
+#[cfg(feature = "io-uring")]
+fn probe_liburing() -> pkg_config::Library {
+    pkg_config::Config::new()
+        .cargo_metadata(false)
+        .probe("liburing")
+        .expect("The io-uring feature was requested but the library is not available")
+}
+
 fn main() {
     let target = env::var("TARGET").unwrap();
 
@@ -37,8 +46,9 @@ fn main() {
 
     #[cfg(feature = "io-uring")]
     if target.contains("linux") {
-        pkg_config::probe_library("liburing")
-            .expect("The io-uring feature was requested but the library is not available");
+        for path in probe_liburing().link_paths {
+            println!("cargo:rustc-link-search=native={}", path.display());
+        }
         builder.define("ROCKSDB_IOURING_PRESENT", Some("1"));
     }
 
@@ -69,19 +79,25 @@ fn main() {
     println!("cargo:rustc-link-lib=static=rocksdb");
     println!("cargo:rustc-link-lib=static=zstd");
     println!("cargo:rustc-link-lib=static=lz4");
-    if cfg!(feature = "lib-uring") {
-        println!("cargo:rustc-link-lib=static=uring");
+    if cfg!(feature = "io-uring") && target.contains("linux") {
+        // after rocksdb, which uses it, for linkers dropping libraries not needed so far
+        println!("cargo:rustc-link-lib=uring");
     }
 
     println!("cargo:rerun-if-changed=src/bridge/mod.rs");
     println!("cargo:rerun-if-changed=bridge/bridge.h");
     println!("cargo:rerun-if-changed=bridge/common.h");
+    println!("cargo:rerun-if-changed=bridge/cf.h");
     println!("cargo:rerun-if-changed=bridge/db.h");
     println!("cargo:rerun-if-changed=bridge/db.cpp");
     println!("cargo:rerun-if-changed=bridge/slice.h");
     println!("cargo:rerun-if-changed=bridge/status.h");
     println!("cargo:rerun-if-changed=bridge/status.cpp");
     println!("cargo:rerun-if-changed=bridge/opts.h");
+    println!("cargo:rerun-if-changed=bridge/perf.h");
+    println!("cargo:rerun-if-changed=bridge/prefix.h");
+    println!("cargo:rerun-if-changed=bridge/ttl.h");
+    println!("cargo:rerun-if-changed=bridge/merge.h");
     println!("cargo:rerun-if-changed=bridge/iter.h");
     println!("cargo:rerun-if-changed=bridge/tx.h");
     println!("cargo:rerun-if-changed=bridge/tx.cpp");
@@ -293,8 +309,9 @@ fn build_rocksdb() {
 
     #[cfg(feature = "io-uring")]
     if target.contains("linux") {
-        pkg_config::probe_library("liburing")
-            .expect("The io-uring feature was requested but the library is not available");
+        for path in probe_liburing().include_paths {
+            config.include(path);
+        }
         config.define("ROCKSDB_IOURING_PRESENT", Some("1"));
     }
 
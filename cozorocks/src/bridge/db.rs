@@ -10,7 +10,7 @@ use cxx::*;
 use std::path::Path;
 
 use crate::bridge::ffi::*;
-use crate::bridge::tx::TxBuilder;
+use crate::bridge::tx::{Tx, TxBuilder};
 
 #[derive(Default, Clone)]
 pub struct DbBuilder {
@@ -45,15 +45,51 @@ impl Default for DbOpts {
             min_blob_size: 0,
             blob_file_size: 1 << 28,
             enable_blob_garbage_collection: false,
+            blob_garbage_collection_age_cutoff: -1.0,
+            blob_file_starting_level: 0,
+            blob_compression: "".to_string(),
+            blob_cache_size: 0,
+            shared_blob_cache: "".to_string(),
+            prepopulate_blob_cache: false,
             use_bloom_filter: false,
             bloom_filter_bits_per_key: 0.0,
             bloom_filter_whole_key_filtering: false,
+            use_ribbon_filter: false,
+            table_block_size: 0,
+            partitioned_index_filters: false,
+            data_block_hash_index: false,
+            data_block_hash_table_util_ratio: 0.75,
             use_capped_prefix_extractor: false,
             capped_prefix_extractor_len: 0,
             use_fixed_prefix_extractor: false,
             fixed_prefix_extractor_len: 0,
+            use_key_columns_prefix_extractor: false,
+            key_columns_prefix_extractor_len: 0,
             destroy_on_exit: false,
             block_cache_size: 0,
+            block_cache_hyper_clock: false,
+            shared_block_cache: "".to_string(),
+            secondary_cache_size: 0,
+            secondary_cache_uri: "".to_string(),
+            relation_column_families: false,
+            relation_cf_options: "".to_string(),
+            optimistic_transactions: false,
+            tx_write_buffer_limit: 0,
+            large_transactions: false,
+            enable_statistics: false,
+            rate_limit_bytes_per_sec: 0,
+            rate_limit_auto_tuned: false,
+            write_buffer_budget: 0,
+            write_buffer_cost_to_cache: false,
+            shared_write_buffer_budget: "".to_string(),
+            fast_open: false,
+            max_open_files: 0,
+            max_file_opening_threads: 0,
+            read_only: false,
+            secondary_path: "".to_string(),
+            enable_pipelined_write: false,
+            wal_ttl_seconds: 0,
+            wal_size_limit_mb: 0,
         }
     }
 }
@@ -100,6 +136,35 @@ impl DbBuilder {
         self.opts.enable_blob_garbage_collection = garbage_collection;
         self
     }
+    /// Blob files are garbage collected once they are in the oldest `age_cutoff` fraction of
+    /// blob files (`0.25` by default), and only written by flushes and compactions into
+    /// `starting_level` or below, so that short-lived large values are not separated.
+    pub fn blob_garbage_collection(mut self, age_cutoff: f64, starting_level: i32) -> Self {
+        self.opts.blob_garbage_collection_age_cutoff = age_cutoff;
+        self.opts.blob_file_starting_level = starting_level;
+        self
+    }
+    /// Compression of the blob files, one of `none`, `snappy`, `zlib`, `lz4`, `lz4hc` and
+    /// `zstd`. Empty keeps the compression from the options file, if any, and none otherwise.
+    pub fn blob_compression(mut self, compression: &str) -> Self {
+        self.opts.blob_compression = compression.to_string();
+        self
+    }
+    /// Cache large values in a cache of `size` bytes of their own (`0` for none), so that they
+    /// do not evict index and data blocks from the block cache. With `prepopulate`, flushes
+    /// put the values they write into the cache. The cache is also used by column families
+    /// enabling blob files in their own options.
+    pub fn blob_cache(mut self, size: usize, prepopulate: bool) -> Self {
+        self.opts.blob_cache_size = size;
+        self.opts.prepopulate_blob_cache = prepopulate;
+        self
+    }
+    /// All databases in the process opened with the same non-empty `name` share one
+    /// blob cache, sized by whichever of them opens first.
+    pub fn shared_blob_cache(mut self, name: &str) -> Self {
+        self.opts.shared_blob_cache = name.to_string();
+        self
+    }
     pub fn use_bloom_filter(
         mut self,
         enable: bool,
@@ -111,6 +176,37 @@ impl DbBuilder {
         self.opts.bloom_filter_whole_key_filtering = whole_key_filtering;
         self
     }
+    /// Same as [Self::use_bloom_filter], but uses a Ribbon filter, which saves about 30% of
+    /// the filter memory at the cost of more CPU when building the filter.
+    /// Takes precedence over the bloom filter if both are enabled.
+    pub fn use_ribbon_filter(
+        mut self,
+        enable: bool,
+        bits_per_key: f64,
+        whole_key_filtering: bool,
+    ) -> Self {
+        self.opts.use_ribbon_filter = enable;
+        self.opts.bloom_filter_bits_per_key = bits_per_key;
+        self.opts.bloom_filter_whole_key_filtering = whole_key_filtering;
+        self
+    }
+    /// Data block size of the SST files in bytes. `0` keeps the default of 16 KiB.
+    pub fn table_block_size(mut self, size: usize) -> Self {
+        self.opts.table_block_size = size;
+        self
+    }
+    /// Use partitioned index and filter blocks, so that only the top-level index
+    /// needs to stay in the block cache.
+    pub fn partitioned_index_filters(mut self, enable: bool) -> Self {
+        self.opts.partitioned_index_filters = enable;
+        self
+    }
+    /// Add a hash index to the data blocks to speed up point lookups.
+    pub fn data_block_hash_index(mut self, enable: bool, util_ratio: f64) -> Self {
+        self.opts.data_block_hash_index = enable;
+        self.opts.data_block_hash_table_util_ratio = util_ratio;
+        self
+    }
     pub fn use_capped_prefix_extractor(mut self, enable: bool, len: usize) -> Self {
         self.opts.use_capped_prefix_extractor = enable;
         self.opts.capped_prefix_extractor_len = len;
@@ -121,6 +217,151 @@ impl DbBuilder {
         self.opts.fixed_prefix_extractor_len = len;
         self
     }
+    /// Use the relation id and the first `n_columns` key columns of keys as their prefix, so that
+    /// prefix Bloom filters serve scans and lookups on the leading key columns of relations.
+    /// Takes precedence over the capped and fixed prefix extractors. The extractor is also
+    /// available as `cozo.KeyColumns.<n_columns>` in options strings, e.g. to choose the number
+    /// of columns of a single relation with `prefix_extractor=cozo.KeyColumns.2`.
+    pub fn use_key_columns_prefix_extractor(mut self, enable: bool, n_columns: usize) -> Self {
+        self.opts.use_key_columns_prefix_extractor = enable;
+        self.opts.key_columns_prefix_extractor_len = n_columns;
+        self
+    }
+    /// Sets the size of the block cache in bytes. `0` uses RocksDB's default cache.
+    /// If `hyper_clock` is true, a HyperClockCache is used instead of an LRU cache.
+    pub fn block_cache(mut self, size: usize, hyper_clock: bool) -> Self {
+        self.opts.block_cache_size = size;
+        self.opts.block_cache_hyper_clock = hyper_clock;
+        self
+    }
+    /// All databases in the process opened with the same non-empty `name` share one
+    /// block cache, sized by whichever of them opens first.
+    pub fn shared_block_cache(mut self, name: &str) -> Self {
+        self.opts.shared_block_cache = name.to_string();
+        self
+    }
+    /// Put a compressed in-memory cache of `size` bytes behind the block cache (`0` for none),
+    /// holding the blocks evicted from the block cache. The block cache must be an LRU cache
+    /// of a given size.
+    pub fn secondary_cache(mut self, size: usize) -> Self {
+        self.opts.secondary_cache_size = size;
+        self
+    }
+    /// Same as [Self::secondary_cache], but with the secondary cache given by its URI in the
+    /// RocksDB object registry, e.g. a cache on local SSDs provided by a plugin, or
+    /// `compressed_secondary_cache://capacity=1073741824;compression_type=kZSTD`.
+    /// Takes precedence over [Self::secondary_cache].
+    pub fn secondary_cache_uri(mut self, uri: &str) -> Self {
+        self.opts.secondary_cache_uri = uri.to_string();
+        self
+    }
+    /// Store each relation in its own column family, created on the first write to the relation.
+    /// `cf_options` are applied to these column families on top of the options of the database,
+    /// in the RocksDB options string format, e.g. `"compaction_style=kCompactionStyleUniversal"`.
+    /// Can only be enabled when the database is created, and stays enabled afterwards.
+    pub fn relation_column_families(mut self, enable: bool, cf_options: &str) -> Self {
+        self.opts.relation_column_families = enable;
+        self.opts.relation_cf_options = cf_options.to_string();
+        self
+    }
+    /// Use optimistic transactions, which take no locks and instead check for conflicts
+    /// when committing. Conflicting commits fail with a status for which
+    /// [RocksDbStatus::is_conflict] is true.
+    pub fn optimistic_transactions(mut self, enable: bool) -> Self {
+        self.opts.optimistic_transactions = enable;
+        self
+    }
+    /// Cap the memory taken by the writes a pessimistic transaction buffers until it commits to
+    /// about `limit` bytes (`0` for no cap). Without [Self::large_transactions], writes beyond
+    /// the cap fail with a status for which [RocksDbStatus::is_memory_limit] is true.
+    pub fn tx_write_buffer_limit(mut self, limit: usize) -> Self {
+        self.opts.tx_write_buffer_limit = limit;
+        self
+    }
+    /// Let pessimistic transactions write what they buffer beyond
+    /// [Self::tx_write_buffer_limit] into the database before they commit, where it stays
+    /// invisible to other transactions until the commit and is removed on rollback, so that
+    /// transactions of any size take bounded memory. This uses the write-unprepared policy of
+    /// RocksDB. The WAL of a database opened with it must be empty (after a clean close) to
+    /// open it without it again. Cannot be combined with [Self::optimistic_transactions].
+    /// Ingesting SST files, deleting ranges, both with [RocksDb::range_del] and on commit,
+    /// and [RocksDb::changes_since] are not supported, while batch writers and read-only
+    /// transactions go through the transaction database.
+    pub fn large_transactions(mut self, enable: bool) -> Self {
+        self.opts.large_transactions = enable;
+        self
+    }
+    /// Collect the RocksDB statistics tickers (block cache hits and misses, stall time, bytes
+    /// read and written, ...) reported by [RocksDb::stats]. This has a small cost on every operation.
+    pub fn enable_statistics(mut self, enable: bool) -> Self {
+        self.opts.enable_statistics = enable;
+        self
+    }
+    /// Limit flushes and compactions to `bytes_per_sec` (`0` for no limit), so that bursts of
+    /// writes leave IO for reads. With `auto_tuned`, RocksDB adjusts the limit to the backlog,
+    /// keeping `bytes_per_sec` as the upper bound.
+    pub fn rate_limit(mut self, bytes_per_sec: usize, auto_tuned: bool) -> Self {
+        self.opts.rate_limit_bytes_per_sec = bytes_per_sec;
+        self.opts.rate_limit_auto_tuned = auto_tuned;
+        self
+    }
+    /// Cap the memory used by the memtables of all column families to `size` bytes (`0` for
+    /// no cap), charging it to the block cache with `cost_to_cache`.
+    pub fn write_buffer_budget(mut self, size: usize, cost_to_cache: bool) -> Self {
+        self.opts.write_buffer_budget = size;
+        self.opts.write_buffer_cost_to_cache = cost_to_cache;
+        self
+    }
+    /// Databases in the same process opened with the same non-empty name share
+    /// a single memtable budget, sized by whichever database opens first.
+    pub fn shared_write_buffer_budget(mut self, name: &str) -> Self {
+        self.opts.shared_write_buffer_budget = name.to_string();
+        self
+    }
+    /// Open an existing database that another process may have open for writing, without
+    /// writing to it. The database does not see what the other process writes afterwards.
+    /// All transactions are read-only.
+    /// Let the WAL write of a commit overlap with the memtable writes of the commits before it,
+    /// which raises the throughput of many threads committing at once.
+    pub fn pipelined_write(mut self, enable: bool) -> Self {
+        self.opts.enable_pipelined_write = enable;
+        self
+    }
+    /// Keep obsolete WAL files for `ttl_seconds`, or until they take more than `size_limit_mb`
+    /// megabytes, so that [RocksDb::changes_since] can still read the writes in them. `0` for
+    /// either leaves it out, and with both `0`, WAL files are removed once flushed.
+    pub fn wal_retention(mut self, ttl_seconds: u64, size_limit_mb: u64) -> Self {
+        self.opts.wal_ttl_seconds = ttl_seconds;
+        self.opts.wal_size_limit_mb = size_limit_mb;
+        self
+    }
+    /// Skip reading the properties and checking the sizes of the SST files when opening, and
+    /// delete obsolete files in the background.
+    pub fn fast_open(mut self, enable: bool) -> Self {
+        self.opts.fast_open = enable;
+        self
+    }
+    /// Keep at most `max_open_files` SST files open (`0` keeps the default of `-1`, for all of
+    /// them), opening them when first read rather than all of them when the database opens.
+    /// The files opened when the database opens are opened by `opening_threads` threads
+    /// (`0` keeps the default of 16).
+    pub fn open_files(mut self, max_open_files: i32, opening_threads: i32) -> Self {
+        self.opts.max_open_files = max_open_files;
+        self.opts.max_file_opening_threads = opening_threads;
+        self
+    }
+    pub fn read_only(mut self, enable: bool) -> Self {
+        self.opts.read_only = enable;
+        self
+    }
+    /// Open an existing database as a secondary instance of the process that has it open for
+    /// writing, following the writes of the primary on [RocksDb::catch_up_with_primary].
+    /// The secondary keeps its own info logs in `secondary_path`. All transactions are
+    /// read-only. An empty path opens the database as usual.
+    pub fn secondary(mut self, secondary_path: &str) -> Self {
+        self.opts.secondary_path = secondary_path.to_string();
+        self
+    }
     pub fn build(self) -> Result<RocksDb, RocksDbStatus> {
         let mut status = RocksDbStatus::default();
 
@@ -133,11 +374,56 @@ impl DbBuilder {
     }
 }
 
+/// Restores the latest backup made by [RocksDb::create_backup] in `backup_dir` into
+/// `db_dir`, which must not be open.
+pub fn restore_from_backup(backup_dir: &str, db_dir: &str) -> Result<(), RocksDbStatus> {
+    let mut status = RocksDbStatus::default();
+    crate::bridge::ffi::restore_from_backup(backup_dir, db_dir, &mut status);
+    if status.is_ok() {
+        Ok(())
+    } else {
+        Err(status)
+    }
+}
+
+/// Length of the prefix that the prefix extractor of
+/// [DbBuilder::use_key_columns_prefix_extractor] with `n_columns` columns takes from `key`,
+/// `0` if the key has fewer columns, in which case it only uses whole key filters.
+pub fn key_columns_prefix_len(key: &[u8], n_columns: usize) -> usize {
+    crate::bridge::ffi::key_columns_prefix_len(key, n_columns)
+}
+
+/// See [RocksDb::write_stall]
+#[derive(Copy, Clone, Debug, Eq, PartialEq)]
+pub enum WriteStall {
+    Normal,
+    Delayed,
+    Stopped,
+}
+
 #[derive(Clone)]
 pub struct RocksDb {
     inner: SharedPtr<RocksDbBridge>,
 }
 
+/// See [RocksDb::downgrade]
+#[derive(Clone)]
+pub struct WeakRocksDb {
+    inner: WeakPtr<RocksDbBridge>,
+}
+
+impl WeakRocksDb {
+    /// The database, if it is still open
+    pub fn upgrade(&self) -> Option<RocksDb> {
+        let inner = self.inner.upgrade();
+        if inner.is_null() {
+            None
+        } else {
+            Some(RocksDb { inner })
+        }
+    }
+}
+
 impl RocksDb {
     pub fn db_path(&self) -> std::string::String {
         self.inner.get_db_path().to_string_lossy().to_string()
@@ -147,6 +433,33 @@ impl RocksDb {
             inner: self.inner.transact(),
         }
     }
+    /// Starts a transaction that reads from a snapshot of the database taken now, without
+    /// the locking and write tracking of a full transaction. Writes to it fail.
+    pub fn transact_read_only(&self) -> Tx {
+        Tx {
+            inner: self.inner.transact_read_only(),
+        }
+    }
+    /// Whether the database was opened with optimistic transactions.
+    pub fn is_optimistic(&self) -> bool {
+        self.inner.is_optimistic()
+    }
+    /// Whether each relation is stored in its own column family.
+    pub fn uses_relation_cfs(&self) -> bool {
+        self.inner.uses_relation_cfs()
+    }
+    /// Creates the column family of a relation ahead of its first write, with its own options
+    /// applied on top of the options of the database.
+    pub fn create_relation_cf(&self, rel_id: u64, cf_options: &str) -> Result<(), RocksDbStatus> {
+        let mut status = RocksDbStatus::default();
+        self.inner
+            .create_relation_cf(rel_id, cf_options, &mut status);
+        if status.is_ok() {
+            Ok(())
+        } else {
+            Err(status)
+        }
+    }
     #[inline]
     pub fn range_del(&self, lower: &[u8], upper: &[u8]) -> Result<(), RocksDbStatus> {
         let mut status = RocksDbStatus::default();
@@ -177,6 +490,166 @@ impl RocksDb {
             Err(status)
         }
     }
+    /// Writes a consistent copy of the database into `dir`, which must not exist yet, that
+    /// can be opened as a database. SST files are hard-linked when `dir` is on the same
+    /// file system, which makes this fast.
+    pub fn checkpoint(&self, dir: &str) -> Result<(), RocksDbStatus> {
+        let mut status = RocksDbStatus::default();
+        self.inner.checkpoint(dir, &mut status);
+        if status.is_ok() {
+            Ok(())
+        } else {
+            Err(status)
+        }
+    }
+    /// Adds a backup to `backup_dir`, only copying the SST files that the backups already
+    /// there do not share. Only the latest `max_backups` backups are kept, unless it is `0`.
+    /// Use [restore_from_backup] to restore the latest one.
+    pub fn create_backup(&self, backup_dir: &str, max_backups: u32) -> Result<(), RocksDbStatus> {
+        let mut status = RocksDbStatus::default();
+        self.inner
+            .create_backup(backup_dir, max_backups, &mut status);
+        if status.is_ok() {
+            Ok(())
+        } else {
+            Err(status)
+        }
+    }
+    /// Estimated size in bytes of the keys in `[lower, upper)`, without reading any data.
+    #[inline]
+    pub fn approximate_size(&self, lower: &[u8], upper: &[u8], include_memtables: bool) -> u64 {
+        self.inner.approximate_size(lower, upper, include_memtables)
+    }
+    /// Estimated number of entries and their size in bytes for the keys in `[lower, upper)`
+    /// that are still in the memtables.
+    #[inline]
+    pub fn approximate_memtable_stats(&self, lower: &[u8], upper: &[u8]) -> (u64, u64) {
+        let mut count = 0;
+        let mut size = 0;
+        self.inner
+            .approximate_memtable_stats(lower, upper, &mut count, &mut size);
+        (count, size)
+    }
+    /// Whether the database was opened with [DbBuilder::read_only] or [DbBuilder::secondary].
+    pub fn is_read_only(&self) -> bool {
+        self.inner.is_read_only()
+    }
+    /// Makes what the primary has written so far visible to a database opened with
+    /// [DbBuilder::secondary]. Relations the primary stores in column families it created
+    /// after the secondary opened only become visible when the secondary reopens.
+    pub fn catch_up_with_primary(&self) -> Result<(), RocksDbStatus> {
+        let mut status = RocksDbStatus::default();
+        self.inner.catch_up_with_primary(&mut status);
+        if status.is_ok() {
+            Ok(())
+        } else {
+            Err(status)
+        }
+    }
+    /// From the next compactions on, drop the versions of the rows of the time travel relation
+    /// `rel_id` that are older than `retention` and are not the version current at that time,
+    /// which time travel to that time or later still needs. With `expire_current`, the current
+    /// versions are dropped as well, so that rows not asserted or retracted within `retention`
+    /// disappear. The retention is not persisted, and must be set again after reopening.
+    pub fn set_validity_retention(
+        &self,
+        rel_id: u64,
+        retention: std::time::Duration,
+        expire_current: bool,
+    ) {
+        let micros = i64::try_from(retention.as_micros()).unwrap_or(i64::MAX);
+        self.inner
+            .set_validity_retention(rel_id, micros, expire_current)
+    }
+    /// Stops dropping the old versions of the rows of the relation `rel_id`.
+    pub fn clear_validity_retention(&self, rel_id: u64) {
+        self.inner.clear_validity_retention(rel_id)
+    }
+    /// A handle that does not keep the database open, e.g. for a background thread that
+    /// should stop once the database is dropped.
+    pub fn downgrade(&self) -> WeakRocksDb {
+        WeakRocksDb {
+            inner: SharedPtr::downgrade(&self.inner),
+        }
+    }
+    /// Splits `[lower, upper)` into at most `n` consecutive parts holding about the same amount
+    /// of data, judging by the boundaries and sizes of the SST files, so that iterators over
+    /// the parts can run on separate threads. Data still in the memtables is not split on.
+    pub fn split_range(&self, lower: &[u8], upper: &[u8], n: usize) -> Vec<(Vec<u8>, Vec<u8>)> {
+        let mut parts = vec![];
+        let mut cursor = lower.to_vec();
+        for split in self.inner.split_range(lower, upper, n) {
+            parts.push((cursor, split.key.clone()));
+            cursor = split.key;
+        }
+        parts.push((cursor, upper.to_vec()));
+        parts
+    }
+    /// Reads back from the WAL the writes to keys in `[lower, upper)` with sequence numbers
+    /// from `since` on, in the order they were made, at most `limit` of them. Also returns the
+    /// sequence number to pass as `since` to get the writes that follow. With a `limit` of `0`,
+    /// only returns the sequence number following the latest write, to start following writes
+    /// from. Writes made without the WAL and ingested SST files are not seen, and writes in WAL
+    /// files already removed are lost, see [DbBuilder::wal_retention].
+    /// Not supported with [DbBuilder::large_transactions].
+    pub fn changes_since(
+        &self,
+        since: u64,
+        lower: &[u8],
+        upper: &[u8],
+        limit: usize,
+    ) -> Result<(Vec<ChangeRecord>, u64), RocksDbStatus> {
+        let mut status = RocksDbStatus::default();
+        let mut changes = vec![];
+        let next = self
+            .inner
+            .changes_since(since, lower, upper, limit, &mut changes, &mut status);
+        if status.is_ok() {
+            Ok((changes, next))
+        } else {
+            Err(status)
+        }
+    }
+    /// Whether RocksDB currently slows down or stops writes, because flushes or compactions
+    /// cannot keep up with them.
+    #[inline]
+    pub fn write_stall(&self) -> WriteStall {
+        match self.inner.write_stall_state() {
+            0 => WriteStall::Normal,
+            1 => WriteStall::Delayed,
+            _ => WriteStall::Stopped,
+        }
+    }
+    /// Opens the SST files holding keys in `[lower, upper)`, loading their index and filter
+    /// blocks into the block cache, so that the first reads of the range do not have to.
+    pub fn warm_up(&self, lower: &[u8], upper: &[u8]) -> Result<(), RocksDbStatus> {
+        let mut status = RocksDbStatus::default();
+        self.inner.warm_up(lower, upper, &mut status);
+        if status.is_ok() {
+            Ok(())
+        } else {
+            Err(status)
+        }
+    }
+    /// Memtable, compaction, write stall and block cache properties and the number of files at
+    /// each level, named after the RocksDB properties they come from, e.g.
+    /// `rocksdb.estimate-pending-compaction-bytes` and `rocksdb.num-files-at-level0`.
+    /// With [DbBuilder::enable_statistics], all statistics tickers follow.
+    pub fn stats(&self) -> Vec<(String, u64)> {
+        self.inner
+            .stats()
+            .into_iter()
+            .map(|stat| (stat.name, stat.value))
+            .collect()
+    }
+    /// Creates a writer that buffers puts and deletes on the C++ side and writes them
+    /// out with a single `DB::Write` every `batch_size` operations (`0` means only when
+    /// explicitly flushed). Writes bypass transactions.
+    pub fn batch_writer(&self, batch_size: usize) -> BatchWriter {
+        BatchWriter {
+            inner: self.inner.write_batch(batch_size),
+        }
+    }
     pub fn get_sst_writer(&self, path: &str) -> Result<SstWriter, RocksDbStatus> {
         let mut status = RocksDbStatus::default();
         let ret = self.inner.get_sst_writer(path, &mut status);
@@ -195,12 +668,33 @@ impl RocksDb {
             Err(status)
         }
     }
+    /// Ingests SST files with non-overlapping key ranges atomically, in a single call.
+    /// With `move_files`, the files are hard-linked into the database instead of copied.
+    /// `allow_global_seqno` must be set if the files may overlap with existing data.
+    pub fn ingest_sst_files(
+        &self,
+        paths: &[String],
+        move_files: bool,
+        allow_global_seqno: bool,
+    ) -> Result<(), RocksDbStatus> {
+        let mut status = RocksDbStatus::default();
+        self.inner
+            .ingest_sst_files(paths, move_files, allow_global_seqno, &mut status);
+        if status.is_ok() {
+            Ok(())
+        } else {
+            Err(status)
+        }
+    }
 }
 
 pub struct SstWriter {
     inner: UniquePtr<SstFileWriterBridge>,
 }
 
+// each writer is only ever used by one thread at a time
+unsafe impl Send for SstWriter {}
+
 impl SstWriter {
     #[inline]
     pub fn put(&mut self, key: &[u8], val: &[u8]) -> Result<(), RocksDbStatus> {
@@ -223,6 +717,64 @@ impl SstWriter {
     }
 }
 
+pub struct BatchWriter {
+    inner: UniquePtr<WriteBatchBridge>,
+}
+
+impl BatchWriter {
+    #[inline]
+    pub fn sync(mut self, val: bool) -> Self {
+        set_w_opts_sync(self.inner.pin_mut().get_w_opts(), val);
+        self
+    }
+    #[inline]
+    pub fn no_slowdown(mut self, val: bool) -> Self {
+        set_w_opts_no_slowdown(self.inner.pin_mut().get_w_opts(), val);
+        self
+    }
+    #[inline]
+    pub fn disable_wal(mut self, val: bool) -> Self {
+        set_w_opts_disable_wal(self.inner.pin_mut().get_w_opts(), val);
+        self
+    }
+    #[inline]
+    pub fn put(&mut self, key: &[u8], val: &[u8]) -> Result<(), RocksDbStatus> {
+        let mut status = RocksDbStatus::default();
+        self.inner.pin_mut().put(key, val, &mut status);
+        if status.is_ok() {
+            Ok(())
+        } else {
+            Err(status)
+        }
+    }
+    #[inline]
+    pub fn del(&mut self, key: &[u8]) -> Result<(), RocksDbStatus> {
+        let mut status = RocksDbStatus::default();
+        self.inner.pin_mut().del(key, &mut status);
+        if status.is_ok() {
+            Ok(())
+        } else {
+            Err(status)
+        }
+    }
+    /// Number of buffered operations not yet written out.
+    #[inline]
+    pub fn pending(&self) -> usize {
+        self.inner.pending()
+    }
+    /// Writes out all buffered operations. Must be called at the end,
+    /// as nothing is written when the writer is dropped.
+    pub fn flush(&mut self) -> Result<(), RocksDbStatus> {
+        let mut status = RocksDbStatus::default();
+        self.inner.pin_mut().flush(&mut status);
+        if status.is_ok() {
+            Ok(())
+        } else {
+            Err(status)
+        }
+    }
+}
+
 unsafe impl Send for RocksDb {}
 
 unsafe impl Sync for RocksDb {}
@@ -73,6 +73,23 @@ impl IterBuilder {
         self.inner.pin_mut().pin_data(val);
         self
     }
+    /// Prefetch blocks asynchronously, which needs the `io-uring` feature to make a difference.
+    #[inline]
+    pub fn async_io(mut self, val: bool) -> Self {
+        self.inner.pin_mut().async_io(val);
+        self
+    }
+    #[inline]
+    pub fn adaptive_readahead(mut self, val: bool) -> Self {
+        self.inner.pin_mut().adaptive_readahead(val);
+        self
+    }
+    /// Readahead size in bytes, `0` lets RocksDB grow it automatically during sequential reads.
+    #[inline]
+    pub fn readahead_size(mut self, val: usize) -> Self {
+        self.inner.pin_mut().readahead_size(val);
+        self
+    }
 }
 
 impl DbIter {
@@ -81,6 +98,22 @@ impl DbIter {
         self.inner.pin_mut().reset();
         IterBuilder { inner: self.inner }
     }
+    /// Moves the iterator to scan `[lower, upper)` instead, positioned at `lower`.
+    /// This is much cheaper than creating a new iterator, as the RocksDB iterator
+    /// underneath is kept whenever possible.
+    #[inline]
+    pub fn retarget(&mut self, lower: &[u8], upper: &[u8]) {
+        self.inner.pin_mut().retarget(lower, upper);
+    }
+    /// Switches to reads suited to long scans, with adaptive readahead of `readahead_size`
+    /// bytes (`0` for automatic), asynchronous when `async_io` is set. The iterator keeps
+    /// its position, and goes back to normal reads when retargeted.
+    #[inline]
+    pub fn use_long_scan_reads(&mut self, async_io: bool, readahead_size: usize) {
+        self.inner
+            .pin_mut()
+            .use_long_scan_reads(async_io, readahead_size);
+    }
     #[inline]
     pub fn seek_to_start(&mut self) {
         self.inner.pin_mut().to_start();
@@ -109,6 +142,64 @@ impl DbIter {
     pub fn prev(&mut self) {
         self.inner.pin_mut().prev();
     }
+    /// Moves past up to `n` entries, starting from the current position, and returns them
+    /// all at once. Fewer entries are returned at the upper bound, or when their total size
+    /// would exceed `max_bytes` (but at least one if there are any). An empty batch means
+    /// the iterator is exhausted.
+    #[inline]
+    pub fn next_batch(
+        &mut self,
+        n: usize,
+        max_bytes: usize,
+    ) -> Result<IterBatch<'_>, RocksDbStatus> {
+        let mut status = RocksDbStatus::default();
+        let data = self.inner.pin_mut().next_batch(n, max_bytes, &mut status);
+        if status.is_ok() {
+            Ok(IterBatch { data })
+        } else {
+            Err(status)
+        }
+    }
+    /// Skip scan returning at most one entry for each distinct key prefix, where the prefix
+    /// is the key without its last `seek_suffix.len()` bytes. Within each prefix the
+    /// iterator seeks to `prefix + seek_suffix`, takes the first entry there unless its
+    /// last byte is non-zero, and then seeks to `prefix + skip_suffix`, which must sort
+    /// after every suffix of the prefix. Batches are bounded as in [DbIter::next_batch].
+    #[inline]
+    pub fn skip_scan_batch(
+        &mut self,
+        n: usize,
+        max_bytes: usize,
+        seek_suffix: &[u8],
+        skip_suffix: &[u8],
+    ) -> Result<IterBatch<'_>, RocksDbStatus> {
+        let mut status = RocksDbStatus::default();
+        let data = self.inner.pin_mut().skip_scan_batch(
+            n,
+            max_bytes,
+            seek_suffix.len(),
+            seek_suffix,
+            skip_suffix,
+            &mut status,
+        );
+        if status.is_ok() {
+            Ok(IterBatch { data })
+        } else {
+            Err(status)
+        }
+    }
+    /// Counts the remaining entries up to the upper bound in a single call, without
+    /// handing each entry over. The iterator is exhausted afterwards.
+    #[inline]
+    pub fn count(&mut self) -> Result<usize, RocksDbStatus> {
+        let mut status = RocksDbStatus::default();
+        let ret = self.inner.pin_mut().count(&mut status);
+        if status.is_ok() {
+            Ok(ret)
+        } else {
+            Err(status)
+        }
+    }
     #[inline]
     pub fn status(&self) -> RocksDbStatus {
         let mut status = RocksDbStatus::default();
@@ -155,3 +246,37 @@ impl DbIter {
         }
     }
 }
+
+/// Key-value pairs returned by [DbIter::next_batch].
+pub struct IterBatch<'a> {
+    data: &'a [u8],
+}
+
+impl<'a> IterBatch<'a> {
+    #[inline]
+    pub fn is_empty(&self) -> bool {
+        self.data.is_empty()
+    }
+    #[inline]
+    fn take_part(&mut self) -> &'a [u8] {
+        let (len, rest) = self.data.split_at(4);
+        let len = u32::from_ne_bytes(len.try_into().unwrap()) as usize;
+        let (part, rest) = rest.split_at(len);
+        self.data = rest;
+        part
+    }
+}
+
+impl<'a> Iterator for IterBatch<'a> {
+    type Item = (&'a [u8], &'a [u8]);
+
+    #[inline]
+    fn next(&mut self) -> Option<Self::Item> {
+        if self.data.is_empty() {
+            return None;
+        }
+        let key = self.take_part();
+        let val = self.take_part();
+        Some((key, val))
+    }
+}
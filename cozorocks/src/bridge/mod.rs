@@ -32,15 +32,83 @@ pub(crate) mod ffi {
         pub min_blob_size: usize,
         pub blob_file_size: usize,
         pub enable_blob_garbage_collection: bool,
+        pub blob_garbage_collection_age_cutoff: f64,
+        pub blob_file_starting_level: i32,
+        pub blob_compression: String,
+        pub blob_cache_size: usize,
+        pub shared_blob_cache: String,
+        pub prepopulate_blob_cache: bool,
         pub use_bloom_filter: bool,
         pub bloom_filter_bits_per_key: f64,
         pub bloom_filter_whole_key_filtering: bool,
+        pub use_ribbon_filter: bool,
+        pub table_block_size: usize,
+        pub partitioned_index_filters: bool,
+        pub data_block_hash_index: bool,
+        pub data_block_hash_table_util_ratio: f64,
         pub use_capped_prefix_extractor: bool,
         pub capped_prefix_extractor_len: usize,
         pub use_fixed_prefix_extractor: bool,
         pub fixed_prefix_extractor_len: usize,
+        pub use_key_columns_prefix_extractor: bool,
+        pub key_columns_prefix_extractor_len: usize,
         pub destroy_on_exit: bool,
         pub block_cache_size: usize,
+        pub block_cache_hyper_clock: bool,
+        pub shared_block_cache: String,
+        pub secondary_cache_size: usize,
+        pub secondary_cache_uri: String,
+        pub relation_column_families: bool,
+        pub relation_cf_options: String,
+        pub optimistic_transactions: bool,
+        pub tx_write_buffer_limit: usize,
+        pub large_transactions: bool,
+        pub enable_statistics: bool,
+        pub rate_limit_bytes_per_sec: usize,
+        pub rate_limit_auto_tuned: bool,
+        pub write_buffer_budget: usize,
+        pub write_buffer_cost_to_cache: bool,
+        pub shared_write_buffer_budget: String,
+        pub enable_pipelined_write: bool,
+        pub wal_ttl_seconds: u64,
+        pub wal_size_limit_mb: u64,
+        pub fast_open: bool,
+        pub max_open_files: i32,
+        pub max_file_opening_threads: i32,
+        pub read_only: bool,
+        pub secondary_path: String,
+    }
+
+    /// A counter or gauge of [RocksDb::stats](crate::RocksDb::stats) or [Tx::perf_stats](crate::Tx::perf_stats)
+    #[derive(Clone, Debug)]
+    pub struct DbStat {
+        pub name: String,
+        pub value: u64,
+    }
+
+    /// See [RocksDb::split_range](crate::RocksDb::split_range)
+    pub struct SplitKey {
+        pub key: Vec<u8>,
+    }
+
+    /// A write read back from the WAL by [RocksDb::changes_since](crate::RocksDb::changes_since)
+    #[derive(Clone, Debug)]
+    pub struct ChangeRecord {
+        pub seq: u64,
+        pub kind: ChangeKind,
+        /// The start of the range for [ChangeKind::DeleteRange]
+        pub key: Vec<u8>,
+        /// Empty for [ChangeKind::Delete], the merge operand for [ChangeKind::Merge]
+        /// and the end of the range for [ChangeKind::DeleteRange]
+        pub value: Vec<u8>,
+    }
+
+    #[derive(Copy, Clone, Debug, Eq, PartialEq)]
+    pub enum ChangeKind {
+        Put,
+        Delete,
+        DeleteRange,
+        Merge,
     }
 
     #[derive(Clone, Debug, Eq, PartialEq)]
@@ -125,7 +193,18 @@ pub(crate) mod ffi {
         type RocksDbBridge;
         fn get_db_path(self: &RocksDbBridge) -> &CxxString;
         fn open_db(builder: &DbOpts, status: &mut RocksDbStatus) -> SharedPtr<RocksDbBridge>;
+        fn restore_from_backup(backup_dir: &str, db_dir: &str, status: &mut RocksDbStatus);
+        fn key_columns_prefix_len(key: &[u8], n_columns: usize) -> usize;
         fn transact(self: &RocksDbBridge) -> UniquePtr<TxBridge>;
+        fn transact_read_only(self: &RocksDbBridge) -> UniquePtr<TxBridge>;
+        fn uses_relation_cfs(self: &RocksDbBridge) -> bool;
+        fn is_optimistic(self: &RocksDbBridge) -> bool;
+        fn create_relation_cf(
+            self: &RocksDbBridge,
+            rel_id: u64,
+            cf_options: &str,
+            status: &mut RocksDbStatus,
+        );
         fn del_range(self: &RocksDbBridge, lower: &[u8], upper: &[u8], status: &mut RocksDbStatus);
         fn put(self: &RocksDbBridge, key: &[u8], val: &[u8], status: &mut RocksDbStatus);
         fn compact_range(
@@ -140,6 +219,69 @@ pub(crate) mod ffi {
             status: &mut RocksDbStatus,
         ) -> UniquePtr<SstFileWriterBridge>;
         fn ingest_sst(self: &RocksDbBridge, path: &str, status: &mut RocksDbStatus);
+        fn ingest_sst_files(
+            self: &RocksDbBridge,
+            paths: &[String],
+            move_files: bool,
+            allow_global_seqno: bool,
+            status: &mut RocksDbStatus,
+        );
+        fn write_batch(self: &RocksDbBridge, batch_size: usize) -> UniquePtr<WriteBatchBridge>;
+        fn approximate_size(
+            self: &RocksDbBridge,
+            lower: &[u8],
+            upper: &[u8],
+            include_memtables: bool,
+        ) -> u64;
+        fn approximate_memtable_stats(
+            self: &RocksDbBridge,
+            lower: &[u8],
+            upper: &[u8],
+            count: &mut u64,
+            size: &mut u64,
+        );
+        fn split_range(self: &RocksDbBridge, lower: &[u8], upper: &[u8], n: usize)
+            -> Vec<SplitKey>;
+        fn changes_since(
+            self: &RocksDbBridge,
+            since: u64,
+            lower: &[u8],
+            upper: &[u8],
+            limit: usize,
+            changes: &mut Vec<ChangeRecord>,
+            status: &mut RocksDbStatus,
+        ) -> u64;
+        fn warm_up(self: &RocksDbBridge, lower: &[u8], upper: &[u8], status: &mut RocksDbStatus);
+        fn stats(self: &RocksDbBridge) -> Vec<DbStat>;
+        fn write_stall_state(self: &RocksDbBridge) -> u8;
+        fn is_read_only(self: &RocksDbBridge) -> bool;
+        fn catch_up_with_primary(self: &RocksDbBridge, status: &mut RocksDbStatus);
+        fn set_validity_retention(
+            self: &RocksDbBridge,
+            rel_id: u64,
+            retention_micros: i64,
+            expire_current: bool,
+        );
+        fn clear_validity_retention(self: &RocksDbBridge, rel_id: u64);
+        fn checkpoint(self: &RocksDbBridge, dir: &str, status: &mut RocksDbStatus);
+        fn create_backup(
+            self: &RocksDbBridge,
+            backup_dir: &str,
+            max_backups: u32,
+            status: &mut RocksDbStatus,
+        );
+
+        type WriteBatchBridge;
+        fn get_w_opts(self: Pin<&mut WriteBatchBridge>) -> Pin<&mut WriteOptions>;
+        fn put(
+            self: Pin<&mut WriteBatchBridge>,
+            key: &[u8],
+            val: &[u8],
+            status: &mut RocksDbStatus,
+        );
+        fn del(self: Pin<&mut WriteBatchBridge>, key: &[u8], status: &mut RocksDbStatus);
+        fn flush(self: Pin<&mut WriteBatchBridge>, status: &mut RocksDbStatus);
+        fn pending(self: &WriteBatchBridge) -> usize;
 
         type SstFileWriterBridge;
         fn put(
@@ -164,19 +306,47 @@ pub(crate) mod ffi {
             for_update: bool,
             status: &mut RocksDbStatus,
         ) -> UniquePtr<PinnableSlice>;
+        fn get_pinned(
+            self: &TxBridge,
+            key: &[u8],
+            for_update: bool,
+            status: &mut RocksDbStatus,
+        ) -> UniquePtr<PinnableSlice>;
+        fn recycle_pinned(self: &TxBridge, slice: UniquePtr<PinnableSlice>);
+        fn multi_get(
+            self: &TxBridge,
+            keys: &[u8],
+            key_lens: &[usize],
+            for_update: bool,
+        ) -> UniquePtr<MultiGetBridge>;
         fn exists(self: &TxBridge, key: &[u8], for_update: bool, status: &mut RocksDbStatus);
         fn put(self: &TxBridge, key: &[u8], val: &[u8], status: &mut RocksDbStatus);
+        fn merge(self: &TxBridge, key: &[u8], operand: &[u8], status: &mut RocksDbStatus);
         fn del(self: &TxBridge, key: &[u8], status: &mut RocksDbStatus);
+        fn par_put(self: &TxBridge, key: &[u8], val: &[u8], status: &mut RocksDbStatus);
+        fn par_del(self: &TxBridge, key: &[u8], status: &mut RocksDbStatus);
+        fn par_flush(self: Pin<&mut TxBridge>, status: &mut RocksDbStatus);
+        fn relation_cfs_in_range(self: &TxBridge, lower: &[u8], upper: &[u8]) -> Vec<u64>;
+        fn drop_relation_cf_on_commit(self: Pin<&mut TxBridge>, rel_id: u64);
+        fn del_range_on_commit(self: Pin<&mut TxBridge>, lower: &[u8], upper: &[u8]);
         fn commit(self: Pin<&mut TxBridge>, status: &mut RocksDbStatus);
+        fn enable_perf_stats(self: Pin<&mut TxBridge>);
+        fn perf_stats(self: &TxBridge) -> Vec<DbStat>;
         fn rollback(self: Pin<&mut TxBridge>, status: &mut RocksDbStatus);
         fn rollback_to_savepoint(self: Pin<&mut TxBridge>, status: &mut RocksDbStatus);
         fn pop_savepoint(self: Pin<&mut TxBridge>, status: &mut RocksDbStatus);
         fn set_savepoint(self: Pin<&mut TxBridge>);
         fn iterator(self: &TxBridge) -> UniquePtr<IterBridge>;
 
+        type MultiGetBridge;
+        fn size(self: &MultiGetBridge) -> usize;
+        fn status_at(self: &MultiGetBridge, idx: usize, status: &mut RocksDbStatus);
+        fn val_at(self: &MultiGetBridge, idx: usize) -> &[u8];
+
         type IterBridge;
         fn start(self: Pin<&mut IterBridge>);
         fn reset(self: Pin<&mut IterBridge>);
+        fn retarget(self: Pin<&mut IterBridge>, lower: &[u8], upper: &[u8]);
         // fn get_r_opts(self: Pin<&mut IterBridge>) -> Pin<&mut ReadOptions>;
         fn clear_bounds(self: Pin<&mut IterBridge>);
         fn set_lower_bound(self: Pin<&mut IterBridge>, bound: &[u8]);
@@ -188,6 +358,10 @@ pub(crate) mod ffi {
         fn auto_prefix_mode(self: Pin<&mut IterBridge>, val: bool);
         fn prefix_same_as_start(self: Pin<&mut IterBridge>, val: bool);
         fn pin_data(self: Pin<&mut IterBridge>, val: bool);
+        fn async_io(self: Pin<&mut IterBridge>, val: bool);
+        fn adaptive_readahead(self: Pin<&mut IterBridge>, val: bool);
+        fn readahead_size(self: Pin<&mut IterBridge>, val: usize);
+        fn use_long_scan_reads(self: Pin<&mut IterBridge>, async_io: bool, readahead_size: usize);
 
         fn to_start(self: Pin<&mut IterBridge>);
         fn to_end(self: Pin<&mut IterBridge>);
@@ -196,10 +370,28 @@ pub(crate) mod ffi {
         fn is_valid(self: &IterBridge) -> bool;
         fn next(self: Pin<&mut IterBridge>);
         fn prev(self: Pin<&mut IterBridge>);
+        fn next_batch(
+            self: Pin<&mut IterBridge>,
+            n: usize,
+            max_bytes: usize,
+            status: &mut RocksDbStatus,
+        ) -> &[u8];
+        fn skip_scan_batch(
+            self: Pin<&mut IterBridge>,
+            n: usize,
+            max_bytes: usize,
+            suffix_len: usize,
+            seek_suffix: &[u8],
+            skip_suffix: &[u8],
+            status: &mut RocksDbStatus,
+        ) -> &[u8];
+        fn count(self: Pin<&mut IterBridge>, status: &mut RocksDbStatus) -> usize;
         fn status(self: &IterBridge, status: &mut RocksDbStatus);
         fn key(self: &IterBridge) -> &[u8];
         fn val(self: &IterBridge) -> &[u8];
     }
+
+    impl WeakPtr<RocksDbBridge> {}
 }
 
 impl Default for ffi::RocksDbStatus {
@@ -261,4 +453,26 @@ impl ffi::RocksDbStatus {
     pub fn is_ok_or_not_found(&self) -> bool {
         self.is_ok() || self.is_not_found()
     }
+    /// Whether a transaction failed because of a concurrent write (or lock contention for
+    /// pessimistic transactions), in which case it can be retried.
+    #[inline(always)]
+    pub fn is_conflict(&self) -> bool {
+        match self.code {
+            ffi::StatusCode::kBusy | ffi::StatusCode::kTryAgain => true,
+            ffi::StatusCode::kTimedOut => self.subcode == ffi::StatusSubCode::kLockTimeout,
+            _ => false,
+        }
+    }
+    /// Whether a write failed because the transaction already buffers as many writes as
+    /// [DbBuilder::tx_write_buffer_limit](crate::DbBuilder::tx_write_buffer_limit) allows.
+    #[inline(always)]
+    pub fn is_memory_limit(&self) -> bool {
+        self.subcode == ffi::StatusSubCode::kMemoryLimit
+    }
+    /// Whether a write failed instead of waiting for RocksDB to stop stalling writes,
+    /// see [TxBuilder::no_slowdown](crate::TxBuilder::no_slowdown).
+    #[inline(always)]
+    pub fn is_write_stall(&self) -> bool {
+        self.code == ffi::StatusCode::kIncomplete
+    }
 }
@@ -42,6 +42,60 @@ impl Debug for PinSlice {
     }
 }
 
+/// A value read with [Tx::get_pinned]. Values found in the block cache are read in place
+/// and stay pinned in the cache until this is dropped.
+pub struct PinnedValue<'a> {
+    tx: &'a TxBridge,
+    inner: UniquePtr<PinnableSlice>,
+}
+
+impl Deref for PinnedValue<'_> {
+    type Target = [u8];
+    fn deref(&self) -> &Self::Target {
+        convert_pinnable_slice_back(&self.inner)
+    }
+}
+
+impl AsRef<[u8]> for PinnedValue<'_> {
+    fn as_ref(&self) -> &[u8] {
+        self as &[u8]
+    }
+}
+
+impl Drop for PinnedValue<'_> {
+    fn drop(&mut self) {
+        // hand the slice back to the transaction for reuse
+        self.tx
+            .recycle_pinned(std::mem::replace(&mut self.inner, UniquePtr::null()));
+    }
+}
+
+pub struct MultiGetResult {
+    pub(crate) inner: UniquePtr<MultiGetBridge>,
+}
+
+impl MultiGetResult {
+    #[inline]
+    pub fn len(&self) -> usize {
+        self.inner.size()
+    }
+    #[inline]
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+    /// Result for the `idx`-th key passed to [Tx::multi_get].
+    #[inline]
+    pub fn get(&self, idx: usize) -> Result<Option<&[u8]>, RocksDbStatus> {
+        let mut status = RocksDbStatus::default();
+        self.inner.status_at(idx, &mut status);
+        match status.code {
+            StatusCode::kOk => Ok(Some(self.inner.val_at(idx))),
+            StatusCode::kNotFound => Ok(None),
+            _ => Err(status),
+        }
+    }
+}
+
 impl TxBuilder {
     #[inline]
     pub fn start(mut self) -> Tx {
@@ -84,6 +138,32 @@ impl TxBuilder {
     }
 }
 
+/// How [Tx::merge] combines a column of the operand with the same column of the value before it.
+/// Columns that do not hold numbers for the arithmetic ops, or lists for [MergeOp::Union],
+/// are replaced.
+#[derive(Copy, Clone, Debug, Eq, PartialEq)]
+#[repr(u8)]
+pub enum MergeOp {
+    Keep = 0,
+    Replace = 1,
+    Sum = 2,
+    Min = 3,
+    Max = 4,
+    /// Appends the elements of the operand list that are not in the list yet
+    Union = 5,
+}
+
+/// A merge operand for [Tx::merge]: `val` is a value in the format of the non-key columns of
+/// stored relations, and `ops` says how each column is combined. Columns without an op are
+/// replaced. Without a value before it, the operand is taken as it is.
+pub fn merge_operand(ops: &[MergeOp], val: &[u8]) -> Vec<u8> {
+    let mut ret = Vec::with_capacity(4 + ops.len() + val.len());
+    ret.extend((ops.len() as u32).to_be_bytes());
+    ret.extend(ops.iter().map(|op| *op as u8));
+    ret.extend_from_slice(val);
+    ret
+}
+
 pub struct Tx {
     pub(crate) inner: UniquePtr<TxBridge>,
 }
@@ -107,6 +187,18 @@ impl Tx {
             Err(status)
         }
     }
+    /// Writes a merge operand made with [merge_operand] without reading the value of `key`,
+    /// which is combined with the operand when it is read.
+    #[inline]
+    pub fn merge(&self, key: &[u8], operand: &[u8]) -> Result<(), RocksDbStatus> {
+        let mut status = RocksDbStatus::default();
+        self.inner.merge(key, operand, &mut status);
+        if status.is_ok() {
+            Ok(())
+        } else {
+            Err(status)
+        }
+    }
     #[inline]
     pub fn del(&self, key: &[u8]) -> Result<(), RocksDbStatus> {
         let mut status = RocksDbStatus::default();
@@ -117,6 +209,61 @@ impl Tx {
             Err(status)
         }
     }
+    /// Same as [Self::put], but can be called from several threads at once, each writing into
+    /// a batch of its own. The write only becomes part of the transaction, and visible to its
+    /// reads, once [Self::par_flush] or [Self::commit] is called. Keys written this way should
+    /// not also be written with [Self::put] or [Self::del] in the same transaction, as the
+    /// parallel writes are applied last. Savepoints do not cover them.
+    #[inline]
+    pub fn par_put(&self, key: &[u8], val: &[u8]) -> Result<(), RocksDbStatus> {
+        let mut status = RocksDbStatus::default();
+        self.inner.par_put(key, val, &mut status);
+        if status.is_ok() {
+            Ok(())
+        } else {
+            Err(status)
+        }
+    }
+    /// Same as [Self::del], in the same way as [Self::par_put].
+    #[inline]
+    pub fn par_del(&self, key: &[u8]) -> Result<(), RocksDbStatus> {
+        let mut status = RocksDbStatus::default();
+        self.inner.par_del(key, &mut status);
+        if status.is_ok() {
+            Ok(())
+        } else {
+            Err(status)
+        }
+    }
+    /// Adds the writes made with [Self::par_put] and [Self::par_del] to the transaction.
+    /// With pessimistic transactions, this is when their keys are locked.
+    pub fn par_flush(&mut self) -> Result<(), RocksDbStatus> {
+        let mut status = RocksDbStatus::default();
+        self.inner.pin_mut().par_flush(&mut status);
+        if status.is_ok() {
+            Ok(())
+        } else {
+            Err(status)
+        }
+    }
+    /// Ids of the relations stored in their own column families whose keys may fall within
+    /// `[lower, upper)`, in ascending order. Always empty unless column families per relation are enabled.
+    #[inline]
+    pub fn relation_cfs_in_range(&self, lower: &[u8], upper: &[u8]) -> Vec<u64> {
+        self.inner.relation_cfs_in_range(lower, upper)
+    }
+    /// Drops the column family of a relation once this transaction commits successfully.
+    #[inline]
+    pub fn drop_relation_cf_on_commit(&mut self, rel_id: u64) {
+        self.inner.pin_mut().drop_relation_cf_on_commit(rel_id)
+    }
+    /// Deletes `[lower, upper)` with a single range tombstone once this transaction commits
+    /// successfully. This happens outside the transaction, so it must only be used for keys
+    /// that nothing reads or writes any more after the commit, such as those of a destroyed relation.
+    #[inline]
+    pub fn del_range_on_commit(&mut self, lower: &[u8], upper: &[u8]) {
+        self.inner.pin_mut().del_range_on_commit(lower, upper)
+    }
     #[inline]
     pub fn get(&self, key: &[u8], for_update: bool) -> Result<Option<PinSlice>, RocksDbStatus> {
         let mut status = RocksDbStatus::default();
@@ -127,6 +274,38 @@ impl Tx {
             _ => Err(status),
         }
     }
+    /// Same as [Tx::get], but without allocating for each read: the value is borrowed from
+    /// a slice reused across the reads of this transaction.
+    #[inline]
+    pub fn get_pinned(
+        &self,
+        key: &[u8],
+        for_update: bool,
+    ) -> Result<Option<PinnedValue<'_>>, RocksDbStatus> {
+        let mut status = RocksDbStatus::default();
+        let ret = PinnedValue {
+            tx: &self.inner,
+            inner: self.inner.get_pinned(key, for_update, &mut status),
+        };
+        match status.code {
+            StatusCode::kOk => Ok(Some(ret)),
+            StatusCode::kNotFound => Ok(None),
+            _ => Err(status),
+        }
+    }
+    /// Looks up all `keys` in a single batched call. The results are in the same order as the keys.
+    pub fn multi_get(&self, keys: &[impl AsRef<[u8]>], for_update: bool) -> MultiGetResult {
+        let mut key_lens = Vec::with_capacity(keys.len());
+        let mut key_data = Vec::with_capacity(keys.iter().map(|k| k.as_ref().len()).sum());
+        for key in keys {
+            let key = key.as_ref();
+            key_lens.push(key.len());
+            key_data.extend_from_slice(key);
+        }
+        MultiGetResult {
+            inner: self.inner.multi_get(&key_data, &key_lens, for_update),
+        }
+    }
     #[inline]
     pub fn exists(&self, key: &[u8], for_update: bool) -> Result<bool, RocksDbStatus> {
         let mut status = RocksDbStatus::default();
@@ -137,6 +316,22 @@ impl Tx {
             _ => Err(status),
         }
     }
+    /// Collects the RocksDB perf context of the reads and writes made from now on through this
+    /// transaction and the iterators created afterwards, see [Tx::perf_stats].
+    #[inline]
+    pub fn enable_perf_stats(&mut self) {
+        self.inner.pin_mut().enable_perf_stats()
+    }
+    /// Perf context counters summed per kind of call, named `<call>.<counter>`, e.g.
+    /// `get.block_cache_hit_count` or `iter.next_batch.block_read_byte`. Only counters
+    /// that are not zero are included. Empty unless [Tx::enable_perf_stats] was called.
+    pub fn perf_stats(&self) -> Vec<(String, u64)> {
+        self.inner
+            .perf_stats()
+            .into_iter()
+            .map(|stat| (stat.name, stat.value))
+            .collect()
+    }
     #[inline]
     pub fn commit(&mut self) -> Result<(), RocksDbStatus> {
         let mut status = RocksDbStatus::default();
@@ -181,6 +376,8 @@ impl Tx {
             Err(status)
         }
     }
+    /// Iterators may be created and dropped from several threads at once. RocksDB transactions
+    /// do not support this by themselves, so the bridge serializes it where they need it.
     #[inline]
     pub fn iterator(&self) -> IterBuilder {
         IterBuilder {
@@ -9,16 +9,28 @@
 #![warn(rust_2018_idioms, future_incompatible)]
 #![allow(clippy::type_complexity)]
 
+pub use bridge::db::key_columns_prefix_len;
+pub use bridge::db::restore_from_backup;
+pub use bridge::db::BatchWriter;
 pub use bridge::db::DbBuilder;
 pub use bridge::db::RocksDb;
+pub use bridge::db::WeakRocksDb;
+pub use bridge::db::WriteStall;
+pub use bridge::ffi::ChangeKind;
+pub use bridge::ffi::ChangeRecord;
 pub use bridge::ffi::RocksDbStatus;
 pub use bridge::ffi::SnapshotBridge;
 pub use bridge::ffi::StatusCode;
 pub use bridge::ffi::StatusSeverity;
 pub use bridge::ffi::StatusSubCode;
 pub use bridge::iter::DbIter;
+pub use bridge::iter::IterBatch;
 pub use bridge::iter::IterBuilder;
+pub use bridge::tx::merge_operand;
+pub use bridge::tx::MergeOp;
+pub use bridge::tx::MultiGetResult;
 pub use bridge::tx::PinSlice;
+pub use bridge::tx::PinnedValue;
 pub use bridge::tx::Tx;
 pub use bridge::tx::TxBuilder;
 